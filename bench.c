@@ -0,0 +1,546 @@
+/*
+	Copyright (C) 2013 - 2014 CurlyMo
+
+	This file is part of pilight.
+
+    pilight is free software: you can redistribute it and/or modify it under the
+	terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later
+	version.
+
+    pilight is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+	A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with pilight. If not, see	<http://www.gnu.org/licenses/>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pilight.h"
+#include "common.h"
+#include "settings.h"
+#include "protocol.h"
+#include "hardware.h"
+#include "log.h"
+#include "options.h"
+#include "dso.h"
+#include "gc.h"
+
+typedef struct bench_train_t {
+	int raw[255];
+	int rawlen;
+	int plslen;
+	int hwtype;
+	int stats;
+	int nrmatches;
+	struct protocol_match_t matches[PROTOCOL_MAX_MATCHES];
+} bench_train_t;
+
+/* Decoding results of all pulse trains with the same label,
+   which is the protocol they were captured or created for */
+typedef struct bench_stats_t {
+	char *name;
+	int trains;
+	int decoded;
+	int foreign;
+	double time;
+} bench_stats_t;
+
+typedef struct bench_result_t {
+	char *label;
+	int decoded;
+	int foreign;
+} bench_result_t;
+
+static struct bench_train_t *trains = NULL;
+static int nrtrains = 0;
+static int sizetrains = 0;
+static struct bench_stats_t *stats = NULL;
+static int nrstats = 0;
+static int minrawlen = 1000;
+static int maxrawlen = 0;
+
+int main_gc(void) {
+	int i = 0;
+
+	log_shell_disable();
+
+	protocol_gc();
+	options_gc();
+	dso_gc();
+	log_gc();
+
+	for(i=0;i<nrstats;i++) {
+		sfree((void *)&stats[i].name);
+	}
+	sfree((void *)&stats);
+	sfree((void *)&trains);
+	sfree((void *)&progname);
+
+	return EXIT_SUCCESS;
+}
+
+static double bench_time(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + ((double)ts.tv_nsec / 1000000000.0);
+}
+
+static int bench_stats_get(const char *name) {
+	int i = 0;
+
+	for(i=0;i<nrstats;i++) {
+		if(strcmp(stats[i].name, name) == 0) {
+			return i;
+		}
+	}
+	if(!(stats = realloc(stats, sizeof(struct bench_stats_t)*(size_t)(nrstats+1)))) {
+		logprintf(LOG_ERR, "out of memory");
+		exit(EXIT_FAILURE);
+	}
+	memset(&stats[nrstats], 0, sizeof(struct bench_stats_t));
+	if(!(stats[nrstats].name = malloc(strlen(name)+1))) {
+		logprintf(LOG_ERR, "out of memory");
+		exit(EXIT_FAILURE);
+	}
+	strcpy(stats[nrstats].name, name);
+	return nrstats++;
+}
+
+/* The same boundaries the daemon uses to filter pulse trains */
+static void bench_rawlen_init(void) {
+	struct protocols_t *pnode = protocols;
+
+	while(pnode) {
+		if(pnode->listener->rawlen < minrawlen && pnode->listener->rawlen > 0) {
+			minrawlen = pnode->listener->rawlen;
+		}
+		if(pnode->listener->minrawlen < minrawlen && pnode->listener->minrawlen > 0) {
+			minrawlen = pnode->listener->minrawlen;
+		}
+		if(pnode->listener->rawlen > maxrawlen) {
+			maxrawlen = pnode->listener->rawlen;
+		}
+		if(pnode->listener->maxrawlen > maxrawlen) {
+			maxrawlen = pnode->listener->maxrawlen;
+		}
+		pnode = pnode->next;
+	}
+}
+
+static void bench_train_add(int *raw, int rawlen, int plslen, int hwtype, const char *label) {
+	struct bench_train_t *train = NULL;
+
+	if(nrtrains == sizetrains) {
+		sizetrains = (sizetrains == 0) ? 1024 : sizetrains*2;
+		if(!(trains = realloc(trains, sizeof(struct bench_train_t)*(size_t)sizetrains))) {
+			logprintf(LOG_ERR, "out of memory");
+			exit(EXIT_FAILURE);
+		}
+	}
+	train = &trains[nrtrains++];
+	memcpy(train->raw, raw, sizeof(int)*(size_t)rawlen);
+	train->rawlen = rawlen;
+	train->plslen = plslen;
+	train->hwtype = hwtype;
+	train->stats = bench_stats_get(label);
+	train->nrmatches = protocol_match(train->hwtype, train->rawlen, train->plslen, train->matches, PROTOCOL_MAX_MATCHES);
+	if(train->nrmatches > PROTOCOL_MAX_MATCHES) {
+		train->nrmatches = PROTOCOL_MAX_MATCHES;
+	}
+	stats[train->stats].trains++;
+}
+
+/* Create a pulse train with the timing of a protocol,
+   random bits and a bit of jitter on every pulse */
+static void bench_create_train(struct protocol_t *proto) {
+	int raw[255];
+	int x = 0, length = proto->plslen->length;
+	int rawlen = proto->rawlen, footer = 0;
+
+	if(rawlen == 0) {
+		rawlen = proto->minrawlen + (rand() % (proto->maxrawlen - proto->minrawlen + 1));
+	}
+	footer = rawlen-1;
+	for(x=0;x<footer;x++) {
+		if(rand() % 2) {
+			raw[x] = length * proto->pulse;
+		} else {
+			raw[x] = length;
+		}
+		raw[x] += (rand() % (length/5+1)) - (length/10);
+	}
+	raw[footer] = length * PULSE_DIV;
+	bench_train_add(raw, rawlen, length, proto->hwtype, proto->id);
+}
+
+/* Create a pulse train of random pulses that passes
+   the raw length filter of the receiver */
+static void bench_create_noise(void) {
+	int raw[255];
+	int x = 0, rawlen = 0, footer = 0, plslen = 100 + (rand() % 400);
+
+	rawlen = minrawlen + (rand() % (maxrawlen - minrawlen + 1));
+	footer = rawlen-1;
+	for(x=0;x<footer;x++) {
+		raw[x] = 100 + (rand() % 2000);
+	}
+	raw[footer] = plslen * PULSE_DIV;
+	bench_train_add(raw, rawlen, plslen, RF433, "noise");
+}
+
+static int bench_create_trains(int nr, int noise) {
+	struct protocols_t *pnode = NULL;
+	struct protocol_t *proto = NULL;
+	int n = 0;
+
+	while(n < nr) {
+		pnode = protocols;
+		while(pnode && n < nr) {
+			proto = pnode->listener;
+			if((proto->parseRaw || proto->parseCode || proto->parseBinary ||
+			   proto->decodeRaw || proto->decodeCode || proto->decodeBinary) &&
+			   proto->plslen && proto->pulse > 0 &&
+			   (proto->rawlen > 0 || (proto->minrawlen > 0 && proto->maxrawlen >= proto->minrawlen))) {
+				bench_create_train(proto);
+				n++;
+			}
+			pnode = pnode->next;
+		}
+		if(n == 0) {
+			logprintf(LOG_ERR, "no protocols to create pulse trains for");
+			return -1;
+		}
+	}
+	for(n=0;n<noise && maxrawlen >= minrawlen;n++) {
+		bench_create_noise();
+	}
+	return nrtrains;
+}
+
+/* Read pulse trains from a capture file as replayed by the 433replay
+   hardware module. The pulses are split into trains the same way the
+   receiver does. A "# protocol: <name>" comment labels the trains that
+   follow, "noise" is used for trains that should not be decoded. */
+static int bench_load_corpus(char *file) {
+	FILE *fp = NULL;
+	char line[255], label[51], *p = NULL, *end = NULL;
+	int raw[255];
+	int rawlen = 0, plslen = 0, duration = 0, nr = 0;
+	long long l = 0;
+
+	if(!(fp = fopen(file, "r"))) {
+		logprintf(LOG_ERR, "could not open corpus %s", file);
+		return -1;
+	}
+
+	strcpy(label, "unlabelled");
+	while(fgets(line, sizeof(line), fp)) {
+		nr++;
+		p = line;
+		while(*p == ' ' || *p == '\t') {
+			p++;
+		}
+		if(*p == '#') {
+			if(sscanf(p, "# protocol: %50s", label) == 1) {
+				rawlen = 0;
+			}
+			continue;
+		}
+		if((end = strchr(p, ':'))) {
+			p = end+1;
+		}
+		/* The duration is the last number on a line */
+		duration = -1;
+		while(1) {
+			l = strtoll(p, &end, 10);
+			if(end == p) {
+				break;
+			}
+			duration = (int)l;
+			p = end;
+		}
+		if(duration == -1) {
+			continue;
+		} else if(duration <= 0) {
+			logprintf(LOG_ERR, "corpus %s, invalid pulse on line %d", file, nr);
+			fclose(fp);
+			return -1;
+		}
+
+		raw[rawlen++] = duration;
+		if(rawlen > 254) {
+			rawlen = 0;
+		}
+		if(duration > 4440) {
+			if((duration/PULSE_DIV) < 3000) {
+				plslen = duration/PULSE_DIV;
+			}
+			if(rawlen >= minrawlen && rawlen <= maxrawlen) {
+				bench_train_add(raw, rawlen, plslen, RF433, label);
+			}
+			rawlen = 0;
+		}
+	}
+	fclose(fp);
+
+	if(nrtrains == 0) {
+		logprintf(LOG_ERR, "corpus %s does not contain any pulse trains", file);
+		return -1;
+	}
+	return nrtrains;
+}
+
+/* Compare the quantization of every candidate protocol on its own
+   with a single, cached quantization pass per pulse train */
+static void bench_quantize(int rounds) {
+	struct protocol_quantize_t quantize;
+	struct bench_train_t *train = NULL;
+	struct protocol_t *proto = NULL;
+	int code[255], check[255];
+	int i = 0, r = 0, t = 0, x = 0, threshold = 0, mismatch = 0;
+	unsigned long sum1 = 0, sum2 = 0;
+	double start = 0.0, loop = 0.0, cached = 0.0;
+
+	for(t=0;t<nrtrains;t++) {
+		train = &trains[t];
+		protocol_quantize_init(&quantize, train->raw, train->rawlen);
+		for(i=0;i<train->nrmatches;i++) {
+			proto = train->matches[i].listener;
+			threshold = train->matches[i].plslen->length * (1+proto->pulse)/2;
+			for(x=0;x<train->rawlen;x++) {
+				check[x] = (train->raw[x] >= threshold) ? 1 : 0;
+			}
+			protocol_quantize_cached(&quantize, threshold, code);
+			if(memcmp(code, check, sizeof(int)*(size_t)train->rawlen) != 0) {
+				mismatch++;
+			}
+		}
+	}
+
+	start = bench_time();
+	for(r=0;r<rounds;r++) {
+		for(t=0;t<nrtrains;t++) {
+			train = &trains[t];
+			for(i=0;i<train->nrmatches;i++) {
+				proto = train->matches[i].listener;
+				threshold = train->matches[i].plslen->length * (1+proto->pulse)/2;
+				for(x=0;x<train->rawlen;x++) {
+					if(train->raw[x] >= threshold) {
+						code[x] = 1;
+					} else {
+						code[x] = 0;
+					}
+				}
+				sum1 += (unsigned long)code[train->rawlen/2];
+			}
+		}
+	}
+	loop = bench_time() - start;
+
+	start = bench_time();
+	for(r=0;r<rounds;r++) {
+		for(t=0;t<nrtrains;t++) {
+			train = &trains[t];
+			protocol_quantize_init(&quantize, train->raw, train->rawlen);
+			for(i=0;i<train->nrmatches;i++) {
+				proto = train->matches[i].listener;
+				threshold = train->matches[i].plslen->length * (1+proto->pulse)/2;
+				protocol_quantize_cached(&quantize, threshold, code);
+				sum2 += (unsigned long)code[train->rawlen/2];
+			}
+		}
+	}
+	cached = bench_time() - start;
+
+	printf("quantization of %d pulse trains, %d rounds\n", nrtrains, rounds);
+#ifdef __SSE2__
+	printf("\t simd\t\t\tsse2\n");
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+	printf("\t simd\t\t\tneon\n");
+#else
+	printf("\t simd\t\t\tnone\n");
+#endif
+	printf("\t per protocol\t\t%.0f trains/sec\n", (double)(nrtrains*rounds)/loop);
+	printf("\t single pass\t\t%.0f trains/sec\n", (double)(nrtrains*rounds)/cached);
+	printf("\t speedup\t\t%.2fx\n", loop/cached);
+	printf("\t mismatches\t\t%d\n", mismatch);
+	if(sum1 != sum2) {
+		printf("\t checksums differ\t%lu != %lu\n", sum1, sum2);
+	}
+}
+
+static void bench_decoded(struct protocol_t *proto, struct protocol_decode_t *decode, void *param) {
+	struct bench_result_t *result = (struct bench_result_t *)param;
+
+	if(decode->message) {
+		if(strcmp(result->label, proto->id) == 0) {
+			result->decoded = 1;
+		} else {
+			result->foreign = 1;
+		}
+	}
+}
+
+/* Run all pulse trains through the decoding of the receiver. Every
+   train is treated as if the minimum number of repeats was received. */
+static void bench_decode(int rounds) {
+	struct bench_result_t result;
+	struct bench_train_t *train = NULL;
+	struct bench_stats_t *stat = NULL;
+	int r = 0, t = 0, noise = -1;
+	double start = 0.0, total = 0.0, elapsed = 0.0;
+
+	for(t=0;t<nrtrains;t++) {
+		train = &trains[t];
+		result.label = stats[train->stats].name;
+		result.decoded = 0;
+		result.foreign = 0;
+		protocol_decode(train->hwtype, train->raw, train->rawlen, train->plslen, hardware_timestamp(), 0, &bench_decoded, &result);
+		stats[train->stats].decoded += result.decoded;
+		stats[train->stats].foreign += result.foreign;
+	}
+
+	for(r=0;r<rounds;r++) {
+		for(t=0;t<nrtrains;t++) {
+			train = &trains[t];
+			start = bench_time();
+			protocol_decode(train->hwtype, train->raw, train->rawlen, train->plslen, hardware_timestamp(), 0, NULL, NULL);
+			elapsed = bench_time() - start;
+			stats[train->stats].time += elapsed;
+			total += elapsed;
+		}
+	}
+
+	printf("decoding of %d pulse trains, %d rounds\n", nrtrains, rounds);
+	printf("\t throughput\t\t%.0f trains/sec\n", (double)(nrtrains*rounds)/total);
+	printf("\t %-24s %8s %8s %8s %10s\n", "label", "trains", "decoded", "foreign", "usec/train");
+	for(t=0;t<nrstats;t++) {
+		stat = &stats[t];
+		if(strcmp(stat->name, "noise") == 0) {
+			noise = t;
+		}
+		printf("\t %-24s %8d %7.1f%% %7.1f%% %10.2f\n", stat->name, stat->trains,
+			100.0*(double)stat->decoded/(double)stat->trains,
+			100.0*(double)stat->foreign/(double)stat->trains,
+			1000000.0*stat->time/(double)(stat->trains*rounds));
+	}
+	if(noise > -1) {
+		printf("\t false matches on noise\t%.2f%%\n", 100.0*(double)stats[noise].foreign/(double)stats[noise].trains);
+	}
+}
+
+int main(int argc, char **argv) {
+
+	gc_attach(main_gc);
+
+	/* Catch all exit signals for gc */
+	gc_catch();
+
+	log_shell_enable();
+	log_file_disable();
+	log_level_set(LOG_NOTICE);
+
+	struct options_t *options = NULL;
+
+	char *args = NULL;
+	char *corpus = NULL;
+	int nr = 1000, rounds = 100, noise = -1;
+
+	if(!(progname = malloc(18))) {
+		logprintf(LOG_ERR, "out of memory");
+		exit(EXIT_FAILURE);
+	}
+	strcpy(progname, "pilight-benchmark");
+
+	options_add(&options, 'H', "help", OPTION_NO_VALUE, 0, JSON_NULL, NULL, NULL);
+	options_add(&options, 'V', "version", OPTION_NO_VALUE, 0, JSON_NULL, NULL, NULL);
+	options_add(&options, 'n', "trains", OPTION_HAS_VALUE, 0, JSON_NULL, NULL, "[0-9]+");
+	options_add(&options, 'r', "rounds", OPTION_HAS_VALUE, 0, JSON_NULL, NULL, "[0-9]+");
+	options_add(&options, 'z', "noise", OPTION_HAS_VALUE, 0, JSON_NULL, NULL, "[0-9]+");
+	options_add(&options, 'c', "corpus", OPTION_HAS_VALUE, 0, JSON_NULL, NULL, NULL);
+
+	while (1) {
+		int c;
+		c = options_parse(&options, argc, argv, 1, &args);
+		if(c == -1)
+			break;
+		if(c == -2)
+			c = 'H';
+		switch (c) {
+			case 'H':
+				printf("Usage: %s [options]\n", progname);
+				printf("\t -H --help\t\tdisplay usage summary\n");
+				printf("\t -V --version\t\tdisplay version\n");
+				printf("\t -n --trains=x\t\tnumber of pulse trains to create\n");
+				printf("\t -r --rounds=x\t\tnumber of times to process the pulse trains\n");
+				printf("\t -z --noise=x\t\tnumber of noise pulse trains to create\n");
+				printf("\t -c --corpus=file\tread the pulse trains from a capture file\n");
+				goto close;
+			break;
+			case 'V':
+				printf("%s %s\n", progname, VERSION);
+				goto close;
+			break;
+			case 'n':
+				nr = atoi(args);
+			break;
+			case 'r':
+				rounds = atoi(args);
+			break;
+			case 'z':
+				noise = atoi(args);
+			break;
+			case 'c':
+				if(!(corpus = realloc(corpus, strlen(args)+1))) {
+					logprintf(LOG_ERR, "out of memory");
+					exit(EXIT_FAILURE);
+				}
+				strcpy(corpus, args);
+			break;
+			default:
+				printf("Usage: %s [options]\n", progname);
+				goto close;
+			break;
+		}
+	}
+	options_delete(options);
+
+	if(nr <= 0 || rounds <= 0) {
+		logprintf(LOG_ERR, "the number of pulse trains and rounds must be larger than 0");
+		goto close;
+	}
+
+	if(noise < 0) {
+		noise = nr/10;
+	}
+
+	protocol_init();
+	bench_rawlen_init();
+
+	srand(1);
+	if(corpus) {
+		if(bench_load_corpus(corpus) <= 0) {
+			goto close;
+		}
+	} else if(bench_create_trains(nr, noise) <= 0) {
+		goto close;
+	}
+
+	bench_quantize(rounds);
+	bench_decode(rounds);
+
+	sfree((void *)&corpus);
+	main_gc();
+	return (EXIT_SUCCESS);
+
+close:
+	sfree((void *)&corpus);
+	main_gc();
+	return (EXIT_FAILURE);
+}
@@ -80,6 +80,8 @@ int main(int argc, char **argv) {
 	memset(values, '\0', 255);
 
 	char *server = NULL;
+	char socketfile[] = SOCKET_FILE;
+	char *socket_file = socketfile;
 	unsigned short port = 0;
 
 	JsonNode *json = NULL;
@@ -170,11 +172,18 @@ int main(int argc, char **argv) {
 		goto close;
 	}
 
+	if(settings_read() != 0) {
+		return EXIT_FAILURE;
+	}
+	settings_find_string("socket-file", &socket_file);
+
 	if(server && port > 0) {
 		if((sockfd = socket_connect(server, port)) == -1) {
 			logprintf(LOG_ERR, "could not connect to pilight-daemon");
 			goto close;
 		}
+	} else if(strlen(socket_file) > 0 && (sockfd = socket_connect(socket_file, 0)) != -1) {
+		/* A daemon running on this machine, no need to look for it */
 	} else if(ssdp_seek(&ssdp_list) == -1) {
 		logprintf(LOG_ERR, "no pilight ssdp connections found");
 		goto close;
@@ -188,10 +197,6 @@ int main(int argc, char **argv) {
 		ssdp_free(ssdp_list);
 	}
 
-	if(settings_read() != 0) {
-		return EXIT_FAILURE;
-	}
-
 	protocol_init();
 
 	while(1) {
@@ -31,6 +31,7 @@
 #include <sys/time.h>
 #include <time.h>
 #include <pthread.h>
+#include <semaphore.h>
 #include <ctype.h>
 #include <dirent.h>
 
@@ -52,6 +53,7 @@
 #include "dso.h"
 #include "firmware.h"
 #include "proc.h"
+#include "queue.h"
 
 #ifdef UPDATE
 	#include "update.h"
@@ -96,6 +98,29 @@ typedef enum {
 	FORWARD
 } steps_t;
 
+/* The finished pulse train of a specific protocol and set of values.
+   The repeats are only expanded into longcode for hardware modules
+   that can't repeat a code themselves. A cached code stays valid until
+   the configuration changes, the queued codes hold a reference. */
+typedef struct sendcache_t {
+	char *key;
+	unsigned int hash;
+	struct protocol_t *protocol;
+	char *message;
+	char *settings;
+	int code[255];
+	int rawlen;
+	int *longcode;
+	int refcount;
+	int cached;
+	struct sendcache_t *next;
+} sendcache_t;
+
+static struct sendcache_t *sendcache = NULL;
+static unsigned int sendcache_number = 0;
+static pthread_mutex_t sendcache_lock;
+static pthread_mutexattr_t sendcache_attr;
+
 typedef struct sendqueue_t {
 	unsigned int id;
 	char *message;
@@ -103,40 +128,143 @@ typedef struct sendqueue_t {
 	char *settings;
 	struct protocol_t *protopt;
 	int code[255];
+	int rawlen;
+	struct sendcache_t *cache;
+	char *device;
+	int priority;
+	unsigned long long queued;
 	char uuid[UUID_LENGTH];
 	struct sendqueue_t *next;
 } sendqueue_t;
 
-static struct sendqueue_t *sendqueue;
-static struct sendqueue_t *sendqueue_head;
+/* Manual control goes ahead of scripted and polled codes */
+typedef enum {
+	SEND_PRIORITY_HIGH = 0,
+	SEND_PRIORITY_NORMAL,
+	SEND_PRIORITY_LOW,
+	SEND_PRIORITIES
+} sendpriority_t;
+
+static struct sendqueue_t *sendqueue[SEND_PRIORITIES];
+static struct sendqueue_t *sendqueue_head[SEND_PRIORITIES];
+
+/* Time spent transmitting by every hardware module */
+typedef struct sendairtime_t {
+	struct hardware_t *hardware;
+	unsigned long long airtime;
+	unsigned long sends;
+	struct sendairtime_t *next;
+} sendairtime_t;
+
+static struct sendairtime_t *sendairtime = NULL;
+
+/* Every transmitter gets its own sender so they can send different
+   codes at the same time. Codes for which no transmitter has been
+   configured are handled by a sender without hardware. */
+typedef struct sendworker_t {
+	struct hardware_t *hardware;
+	struct sendqueue_t *node;
+	struct sendworker_t *next;
+} sendworker_t;
+
+static struct sendworker_t *sendworkers = NULL;
+static unsigned long long sendqueue_wait = 0;
+static unsigned long long sendqueue_wait_max = 0;
+static unsigned long sendqueue_waited = 0;
+static unsigned long sendqueue_coalesced = 0;
+static unsigned long long sendqueue_reported = 0;
 
 typedef struct recvqueue_t {
 	int raw[255];
 	int rawlen;
 	int hwtype;
 	int plslen;
-	struct recvqueue_t *next;
+	unsigned long long timestamp;
 } recvqueue_t;
 
-static struct recvqueue_t *recvqueue;
-static struct recvqueue_t *recvqueue_head;
+/* Our own recent transmissions as heard by a receiver */
+#define RECEIVE_ECHO_WINDOWS	8
+
+/* Why the pre-filter threw away a pulse train */
+typedef enum {
+	RECEIVE_FILTER_FOOTER,
+	RECEIVE_FILTER_PULSE,
+	RECEIVE_FILTER_HISTOGRAM,
+	RECEIVE_FILTER_REASONS
+} recvfilter_t;
+
+static const char *recvfilter_names[RECEIVE_FILTER_REASONS] = {
+	"footer", "pulse", "histogram"
+};
+
+typedef struct recvecho_t {
+	struct hardware_t *sender;
+	unsigned long long start;
+	unsigned long long end;
+} recvecho_t;
+
+/* Every receiver writes into its own preallocated single-producer,
+   single-consumer ring so the receiving threads never have to allocate
+   memory or wait for a lock. The head is only written by the producer,
+   the tail only by the decoder holding the recvqueue_lock. */
+typedef struct recvring_t {
+	char *id;
+	struct hardware_t *hardware;
+	struct recvqueue_t nodes[RECEIVE_QUEUE_SIZE];
+	volatile unsigned int head;
+	volatile unsigned int tail;
+	struct queue_t *queue;
+	unsigned long reported;
+	struct recvecho_t echo[RECEIVE_ECHO_WINDOWS];
+	unsigned int echo_nr;
+	unsigned long echoed;
+	/* Only updated by the receiver itself */
+	unsigned long passed;
+	unsigned long filtered[RECEIVE_FILTER_REASONS];
+	unsigned long passed_reported;
+	unsigned long filtered_reported[RECEIVE_FILTER_REASONS];
+	struct recvring_t *next;
+} recvring_t;
+
+static struct recvring_t *recvrings = NULL;
+/* Ring for pulse trains not coming from a receiver (e.g. looped back raw codes) */
+static struct recvring_t *recvring_internal = NULL;
+static pthread_mutex_t recvring_internal_lock;
+static pthread_mutexattr_t recvring_internal_attr;
+static sem_t recvqueue_sem;
+
+/* Taking pulse trains from the rings is serialized between the decoders,
+   the decoding itself is not. Every pulse train gets a sequence number so
+   the decoders can hand over their results in the order of arrival. */
+static pthread_mutex_t recvqueue_lock;
+static pthread_cond_t recvqueue_signal;
+static pthread_mutexattr_t recvqueue_attr;
+static struct recvring_t *recvring_next = NULL;
+static unsigned long recvqueue_seq = 0;
+static unsigned long recvqueue_done = 0;
+
+/* Raw, code and binary message of every matching protocol */
+#define RECEIVE_MAX_MESSAGES	(PROTOCOL_MAX_MATCHES*3)
+
+typedef struct recvresult_t {
+	int nr;
+	struct {
+		char *protoname;
+		JsonNode *json;
+	} messages[RECEIVE_MAX_MESSAGES];
+} recvresult_t;
 
 static pthread_mutex_t sendqueue_lock;
 static pthread_cond_t sendqueue_signal;
 static pthread_mutexattr_t sendqueue_attr;
 
 static int sendqueue_number = 0;
+static struct queue_t *sendqueue_nodes = NULL;
 
+/* Protects the echo windows of the receivers */
 static pthread_mutex_t receive_lock;
-static pthread_cond_t receive_signal;
 static pthread_mutexattr_t receive_attr;
 
-static int recvqueue_number = 0;
-
-static pthread_mutex_t recvqueue_lock;
-static pthread_cond_t recvqueue_signal;
-static pthread_mutexattr_t recvqueue_attr;
-
 typedef struct bcqueue_t {
 	JsonNode *jmessage;
 	char *protoname;
@@ -145,6 +273,7 @@ typedef struct bcqueue_t {
 
 static struct bcqueue_t *bcqueue = NULL;
 static struct bcqueue_t *bcqueue_head = NULL;
+static struct queue_t *bcqueue_nodes = NULL;
 
 static pthread_mutex_t bcqueue_lock;
 static pthread_cond_t bcqueue_signal;
@@ -168,8 +297,14 @@ static int running = 1;
 static int send_repeat = 0;
 /* How many times does a code need to received*/
 static int receive_repeat = RECEIVE_REPEATS;
-/* Are we currently sending code */
-static int sending = 0;
+/* Number of threads decoding received pulse trains */
+static int receive_workers = RECEIVE_WORKERS;
+/* Throw away pulse trains that can't be a code before queueing them */
+static int receive_filter = RECEIVE_FILTER;
+/* Shortest pulse in us a code may contain, defaults to half
+   the shortest pulse length of all protocols. Pulses longer
+   than 4440us already end a pulse train. */
+static int receive_min_pulse = 0;
 /* If we have accepted a client, handshakes will store the type of client */
 static short handshakes[MAX_CLIENTS];
 /* Which mode are we running in: 1 = server, 2 = client */
@@ -182,8 +317,6 @@ static unsigned short incognito_mode = 0;
 static pthread_t pth;
 /* While loop conditions */
 static unsigned short main_loop = 1;
-/* Reset repeats after a certian amount of time */
-static struct timeval tv;
 /* How many nodes are connected */
 static int nrnodes = 0;
 /* Are we running standalone */
@@ -248,14 +381,10 @@ static void node_remove(int id) {
 }
 
 static void broadcast_queue(char *protoname, JsonNode *json) {
-	pthread_mutex_lock(&bcqueue_lock);
-	if(bcqueue_number <= 1024) {
-		struct bcqueue_t *bnode = malloc(sizeof(struct bcqueue_t));
-		if(!bnode) {
-			logprintf(LOG_ERR, "out of memory");
-			exit(EXIT_FAILURE);
-		}
+	struct bcqueue_t *bnode = NULL;
 
+	pthread_mutex_lock(&bcqueue_lock);
+	if((bnode = queue_alloc(bcqueue_nodes)) != NULL) {
 		char *jstr = json_stringify(json, NULL);
 		bnode->jmessage = json_decode(jstr);
 		if(json_find_member(bnode->jmessage, "uuid") == NULL && strlen(pilight_uuid) > 0) {
@@ -286,13 +415,49 @@ static void broadcast_queue(char *protoname, JsonNode *json) {
 	pthread_cond_signal(&bcqueue_signal);
 }
 
-void *broadcast(void *param) {
+/* Write a message to all clients of a certain type, serialized once
+   for every format in use. Returns 1 when there was at least one of them */
+static int broadcast_frame(int type, JsonNode *json, const char *msg) {
+	struct socket_frame_t *frame = NULL, *binary = NULL;
 	int i = 0, broadcasted = 0;
 
+	for(i=0;i<MAX_CLIENTS;i++) {
+		if(handshakes[i] != type) {
+			continue;
+		}
+		if(socket_get_binary(i) == 1) {
+			if(!binary) {
+				binary = socket_frame_create_binary(json);
+			}
+			if(socket_write_frame(i, binary) == 0) {
+				broadcasted = 1;
+			}
+		} else {
+			if(!frame) {
+				frame = socket_frame_create(msg);
+			}
+			if(socket_write_frame(i, frame) == 0) {
+				broadcasted = 1;
+			}
+		}
+	}
+	if(frame) {
+		socket_frame_free(frame);
+	}
+	if(binary) {
+		socket_frame_free(binary);
+	}
+	return broadcasted;
+}
+
+void *broadcast(void *param) {
+	int broadcasted = 0;
+
 	pthread_mutex_lock(&bcqueue_lock);
 	while(main_loop) {
 		if(bcqueue_number > 0) {
 			pthread_mutex_lock(&bcqueue_lock);
+			queue_dequeued(bcqueue_nodes, bcqueue);
 
 			broadcasted = 0;
 			JsonNode *jret = NULL;
@@ -301,12 +466,7 @@ void *broadcast(void *param) {
 			if(json_find_string(bcqueue->jmessage, "origin", &origin) == 0) {
 				if(strcmp(origin, "config") == 0) {
 					char *conf = json_stringify(bcqueue->jmessage, NULL);
-					for(i=0;i<MAX_CLIENTS;i++) {
-						if(handshakes[i] == GUI) {
-							socket_write(socket_get_clients(i), conf);
-							broadcasted = 1;
-						}
-					}
+					broadcasted = broadcast_frame(GUI, bcqueue->jmessage, conf);
 					if(broadcasted == 1) {
 						logprintf(LOG_DEBUG, "broadcasted: %s", conf);
 					}
@@ -315,12 +475,7 @@ void *broadcast(void *param) {
 					/* Update the config */
 					if(config_update(bcqueue->protoname, bcqueue->jmessage, &jret) == 0) {
 						char *conf = json_stringify(jret, NULL);
-						for(i=0;i<MAX_CLIENTS;i++) {
-							if(handshakes[i] == GUI) {
-								socket_write(socket_get_clients(i), conf);
-								broadcasted = 1;
-							}
-						}
+						broadcasted = broadcast_frame(GUI, jret, conf);
 
 						if(broadcasted == 1) {
 							logprintf(LOG_DEBUG, "broadcasted: %s", conf);
@@ -341,7 +496,17 @@ void *broadcast(void *param) {
 						strcpy(jcode->key, "code");
 					}
 
-					char *jinternal = json_stringify(bcqueue->jmessage, NULL);
+					broadcasted = 0;
+
+					/* Nodes update their master including the settings */
+					if(runmode == 2 && sockfd > 0) {
+						JsonNode *jupdate = json_mkstring("update");
+						json_append_member(bcqueue->jmessage, "message", jupdate);
+						socket_write_json(sockfd, bcqueue->jmessage);
+						json_remove_from_parent(jupdate);
+						json_delete(jupdate);
+						broadcasted = 1;
+					}
 
 					JsonNode *jsettings = NULL;
 					if((jsettings = json_find_member(bcqueue->jmessage, "settings"))) {
@@ -358,8 +523,6 @@ void *broadcast(void *param) {
 							json_find_number(code, "hpf", &firmware.hpf);
 						}
 					}
-					broadcasted = 0;
-
 					struct JsonNode *childs = json_first_child(bcqueue->jmessage);
 					int nrchilds = 0;
 					while(childs) {
@@ -367,31 +530,16 @@ void *broadcast(void *param) {
 						childs = childs->next;
 					}
 
-					if(receivers > 0) {
+					if(receivers > 0 && strcmp(jbroadcast, "{}") != 0 && nrchilds > 1) {
 						/* Write the message to all receivers */
-						for(i=0;i<MAX_CLIENTS;i++) {
-							if(handshakes[i] == RECEIVER) {
-								if(strcmp(jbroadcast, "{}") != 0 && nrchilds > 1) {
-									socket_write(socket_get_clients(i), jbroadcast);
-									broadcasted = 1;
-								}
-							}
+						if(broadcast_frame(RECEIVER, bcqueue->jmessage, jbroadcast) == 1) {
+							broadcasted = 1;
 						}
 					}
 
-					if(runmode == 2 && sockfd > 0) {
-						struct JsonNode *jupdate = json_decode(jinternal);
-						json_append_member(jupdate, "message", json_mkstring("update"));
-						char *ret = json_stringify(jupdate, NULL);
-						socket_write(sockfd, ret);
-						broadcasted = 1;
-						json_delete(jupdate);
-						sfree((void *)&ret);
-					}
 					if((broadcasted == 1 || nodaemon == 1) && (strcmp(jbroadcast, "{}") != 0 && nrchilds > 1)) {
 						logprintf(LOG_DEBUG, "broadcasted: %s", jbroadcast);
 					}
-					sfree((void *)&jinternal);
 					sfree((void *)&jbroadcast);
 				}
 			}
@@ -399,7 +547,7 @@ void *broadcast(void *param) {
 			sfree((void *)&tmp->protoname);
 			json_delete(tmp->jmessage);
 			bcqueue = bcqueue->next;
-			sfree((void *)&tmp);
+			queue_free(bcqueue_nodes, tmp);
 			bcqueue_number--;
 			pthread_mutex_unlock(&bcqueue_lock);
 		} else {
@@ -409,43 +557,229 @@ void *broadcast(void *param) {
 	return (void *)NULL;
 }
 
+static struct recvring_t *receive_ring_create(const char *id, struct hardware_t *hw) {
+	char name[255];
+	struct recvring_t *ring = malloc(sizeof(struct recvring_t));
+	if(!ring) {
+		logprintf(LOG_ERR, "out of memory");
+		exit(EXIT_FAILURE);
+	}
+	if(!(ring->id = malloc(strlen(id)+1))) {
+		logprintf(LOG_ERR, "out of memory");
+		exit(EXIT_FAILURE);
+	}
+	strcpy(ring->id, id);
+	ring->hardware = hw;
+	ring->head = 0;
+	ring->tail = 0;
+	snprintf(name, sizeof(name), "receiver-%s", id);
+	ring->queue = queue_create(name, RECEIVE_QUEUE_SIZE, 0);
+	ring->reported = 0;
+	memset(ring->echo, 0, sizeof(ring->echo));
+	ring->echo_nr = 0;
+	ring->echoed = 0;
+	ring->passed = 0;
+	ring->passed_reported = 0;
+	memset(ring->filtered, 0, sizeof(ring->filtered));
+	memset(ring->filtered_reported, 0, sizeof(ring->filtered_reported));
+	ring->next = recvrings;
+	recvrings = ring;
+	return ring;
+}
+
+static void receive_ring_gc(void) {
+	struct recvring_t *tmp = NULL;
+	while(recvrings) {
+		tmp = recvrings;
+		recvrings = recvrings->next;
+		sfree((void *)&tmp->id);
+		sfree((void *)&tmp);
+	}
+	recvring_internal = NULL;
+}
+
+/* May only be called by the single producer of the ring */
+static void receive_ring_push(struct recvring_t *ring, int *raw, int rawlen, int plslen, int hwtype, unsigned long long timestamp) {
+	struct recvqueue_t *rnode = NULL;
+	int i = 0;
+
+	if((ring->head - ring->tail) >= RECEIVE_QUEUE_SIZE) {
+		queue_drop(ring->queue);
+		return;
+	}
+
+	rnode = &ring->nodes[ring->head % RECEIVE_QUEUE_SIZE];
+	for(i=0;i<rawlen;i++) {
+		rnode->raw[i] = raw[i];
+	}
+	rnode->rawlen = rawlen;
+	rnode->plslen = plslen;
+	rnode->hwtype = hwtype;
+	rnode->timestamp = timestamp;
+
+	/* Make sure the node is written before it's published */
+	__sync_synchronize();
+	ring->head++;
+	queue_push(ring->queue);
+	sem_post(&recvqueue_sem);
+}
+
 static void receive_queue(int *raw, int rawlen, int plslen, int hwtype) {
+	pthread_mutex_lock(&recvring_internal_lock);
+	if(recvring_internal) {
+		receive_ring_push(recvring_internal, raw, rawlen, plslen, hwtype, hardware_timestamp());
+	}
+	pthread_mutex_unlock(&recvring_internal_lock);
+}
+
+static void receive_ring_report(void) {
+	struct recvring_t *tmp = recvrings;
+	unsigned long filtered = 0, passed = 0;
 	int i = 0;
 
-	pthread_mutex_lock(&recvqueue_lock);
-	if(recvqueue_number <= 1024) {
-		struct recvqueue_t *rnode = malloc(sizeof(struct recvqueue_t));
-		if(!rnode) {
-			logprintf(LOG_ERR, "out of memory");
-			exit(EXIT_FAILURE);
+	while(tmp) {
+		passed = tmp->passed;
+		if(passed != tmp->passed_reported) {
+			logprintf(LOG_DEBUG, "%s receiver passed %lu pulse trains", tmp->id, passed-tmp->passed_reported);
+			tmp->passed_reported = passed;
+		}
+		for(i=0;i<RECEIVE_FILTER_REASONS;i++) {
+			filtered = tmp->filtered[i];
+			if(filtered != tmp->filtered_reported[i]) {
+				logprintf(LOG_DEBUG, "%s receiver filtered %lu pulse trains on their %s", tmp->id, filtered-tmp->filtered_reported[i], recvfilter_names[i]);
+				tmp->filtered_reported[i] = filtered;
+			}
+		}
+		if(tmp->queue->dropped != tmp->reported) {
+			logprintf(LOG_NOTICE, "%s receiver queue full, dropped %lu pulse trains", tmp->id, tmp->queue->dropped-tmp->reported);
+			tmp->reported = tmp->queue->dropped;
 		}
-		for(i=0;i<rawlen;i++) {
-			rnode->raw[i] = raw[i];
+		if(tmp->echoed > 0) {
+			logprintf(LOG_DEBUG, "%s receiver ignored %lu pulse trains of our own transmitter", tmp->id, tmp->echoed);
+			tmp->echoed = 0;
 		}
-		rnode->rawlen = rawlen;
-		rnode->plslen = plslen;
-		rnode->hwtype = hwtype;
+		tmp = tmp->next;
+	}
+}
 
-		if(recvqueue_number == 0) {
-			recvqueue = rnode;
-			recvqueue_head = rnode;
-		} else {
-			recvqueue_head->next = rnode;
-			recvqueue_head = rnode;
+/* Mark the start of a transmission for all receivers of the same type,
+   the window stays open until the transmission has ended */
+static void receive_echo_open(struct hardware_t *hw) {
+	struct recvring_t *tmp = recvrings;
+	struct recvecho_t *echo = NULL;
+	unsigned long long now = hardware_timestamp();
+
+	pthread_mutex_lock(&receive_lock);
+	while(tmp) {
+		if(tmp->hardware && tmp->hardware->type == hw->type) {
+			echo = &tmp->echo[tmp->echo_nr % RECEIVE_ECHO_WINDOWS];
+			echo->sender = hw;
+			echo->start = now;
+			echo->end = ~0ULL;
+			tmp->echo_nr++;
 		}
+		tmp = tmp->next;
+	}
+	pthread_mutex_unlock(&receive_lock);
+}
 
-		recvqueue_number++;
-	} else {
-		logprintf(LOG_ERR, "receiver queue full");
+static void receive_echo_close(struct hardware_t *hw) {
+	struct recvring_t *tmp = recvrings;
+	unsigned long long now = hardware_timestamp();
+	int i = 0;
+
+	pthread_mutex_lock(&receive_lock);
+	while(tmp) {
+		for(i=0;i<RECEIVE_ECHO_WINDOWS;i++) {
+			if(tmp->echo[i].sender == hw && tmp->echo[i].end == ~0ULL) {
+				tmp->echo[i].end = now+(RECEIVE_ECHO_GUARD*1000000ULL);
+			}
+		}
+		tmp = tmp->next;
 	}
-	pthread_mutex_unlock(&recvqueue_lock);
-	pthread_cond_signal(&recvqueue_signal);
+	pthread_mutex_unlock(&receive_lock);
+}
+
+/* Check if a pulse train ending at timestamp overlaps with
+   one of our own transmissions */
+static int receive_echo(struct recvring_t *ring, int *raw, int rawlen, unsigned long long timestamp) {
+	unsigned long long start = timestamp, length = 0;
+	int i = 0, echo = 0;
+
+	for(i=0;i<rawlen;i++) {
+		length += (unsigned long long)raw[i]*1000ULL;
+	}
+	if(length < start) {
+		start -= length;
+	}
+
+	pthread_mutex_lock(&receive_lock);
+	for(i=0;i<RECEIVE_ECHO_WINDOWS;i++) {
+		if(ring->echo[i].end > 0 && start <= ring->echo[i].end && timestamp >= ring->echo[i].start) {
+			ring->echoed++;
+			echo = 1;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&receive_lock);
+	return echo;
+}
+
+/* Add the number of pulse trains that passed and were
+   filtered by all receivers since they started */
+static void receive_filter_report(JsonNode *code) {
+	struct recvring_t *tmp = recvrings;
+	unsigned long passed = 0, filtered = 0;
+	int i = 0;
+
+	while(tmp) {
+		passed += tmp->passed;
+		for(i=0;i<RECEIVE_FILTER_REASONS;i++) {
+			filtered += tmp->filtered[i];
+		}
+		tmp = tmp->next;
+	}
+	json_append_member(code, "receive-passed", json_mknumber((double)passed));
+	json_append_member(code, "receive-filtered", json_mknumber((double)filtered));
+}
+
+/* Cheap sanity checks on a pulse train so the decoders don't spend
+   their time on interference. Returns 0 when it could be a code. */
+static int receive_prefilter(struct recvring_t *ring, int *raw, int rawlen, int plslen, int footer) {
+	int i = 0, nrshort = 0, nrpulses = rawlen-1;
+
+	/* The footer should end a pulse train of some protocol */
+	if((footer/PULSE_DIV) >= 3000 || protocol_possible(ring->hardware->type, rawlen, plslen) == 0) {
+		ring->filtered[RECEIVE_FILTER_FOOTER]++;
+		return -1;
+	}
+
+	for(i=0;i<nrpulses;i++) {
+		if(raw[i] < receive_min_pulse) {
+			ring->filtered[RECEIVE_FILTER_PULSE]++;
+			return -1;
+		}
+		if(raw[i] <= plslen+(plslen/2)) {
+			nrshort++;
+		}
+	}
+
+	/* Codes are made of pulses of the length the footer announces
+	   and a few multiples of it, so the short ones are never rare.
+	   Interference has its pulses all over the place. */
+	if(nrshort*RECEIVE_FILTER_SHORT < nrpulses) {
+		ring->filtered[RECEIVE_FILTER_HISTOGRAM]++;
+		return -1;
+	}
+	return 0;
 }
 
-static void receiver_create_message(protocol_t *protocol) {
-	if(protocol->message) {
-		char *valid = json_stringify(protocol->message, NULL);
-		json_delete(protocol->message);
+static void receiver_create_message(protocol_t *protocol, struct protocol_decode_t *decode, void *param) {
+	struct recvresult_t *result = (struct recvresult_t *)param;
+
+	if(decode->message) {
+		char *valid = json_stringify(decode->message, NULL);
+		json_delete(decode->message);
 		if(valid && json_validate(valid) == true) {
 			JsonNode *jmessage = json_mkobject();
 
@@ -455,153 +789,487 @@ static void receiver_create_message(protocol_t *protocol) {
 			if(strlen(pilight_uuid) > 0) {
 				json_append_member(jmessage, "uuid", json_mkstring(pilight_uuid));
 			}
-			if(protocol->repeats > -1) {
-				json_append_member(jmessage, "repeats", json_mknumber(protocol->repeats));
+			if(decode->repeats > -1) {
+				json_append_member(jmessage, "repeats", json_mknumber(decode->repeats));
 			}
 			char *output = json_stringify(jmessage, NULL);
-			JsonNode *json = json_decode(output);
-			broadcast_queue(protocol->id, json);
+			if(result->nr < RECEIVE_MAX_MESSAGES) {
+				result->messages[result->nr].protoname = protocol->id;
+				result->messages[result->nr].json = json_decode(output);
+				result->nr++;
+			}
 			sfree((void *)&output);
-			json_delete(json);
-			json = NULL;
 			json_delete(jmessage);
 		}
-		protocol->message = NULL;
+		decode->message = NULL;
 		sfree((void *)&valid);
 	}
 }
 
 void *receive_parse_code(void *param) {
+	struct recvring_t *ring = NULL;
+	struct recvqueue_t rnode;
+	struct recvqueue_t *recvqueue = &rnode;
+	struct recvresult_t result;
+	unsigned long seq = 0;
+	int i = 0;
 
-	pthread_mutex_lock(&recvqueue_lock);
 	while(main_loop) {
-		if(recvqueue_number > 0) {
+		if(sem_wait(&recvqueue_sem) == 0 && main_loop) {
 			pthread_mutex_lock(&recvqueue_lock);
+			/* Serve the receivers round robin */
+			ring = (recvring_next && recvring_next->next) ? recvring_next->next : recvrings;
+			while(ring->head == ring->tail) {
+				ring = (ring->next) ? ring->next : recvrings;
+			}
+			recvring_next = ring;
+			__sync_synchronize();
+			memcpy(recvqueue, &ring->nodes[ring->tail % RECEIVE_QUEUE_SIZE], sizeof(struct recvqueue_t));
+			/* Release the node as soon as we have our own copy */
+			__sync_synchronize();
+			ring->tail++;
+			queue_pop(ring->queue, recvqueue->timestamp);
+			seq = recvqueue_seq++;
+			pthread_mutex_unlock(&recvqueue_lock);
 
-			struct protocol_t *protocol = NULL;
-			struct protocols_t *pnode = protocols;
-			struct protocol_plslen_t *plslengths = NULL;
-			int x = 0, match = 0;
+			result.nr = 0;
+			protocol_decode(recvqueue->hwtype, recvqueue->raw, recvqueue->rawlen, recvqueue->plslen, recvqueue->timestamp, receive_repeat, &receiver_create_message, &result);
 
-			while(pnode && main_loop) {
-				protocol = pnode->listener;
-				match = 0;
+			/* Wait for the decoders of earlier pulse trains
+			   so the messages are broadcasted in order */
+			pthread_mutex_lock(&recvqueue_lock);
+			while(main_loop && recvqueue_done != seq) {
+				pthread_cond_wait(&recvqueue_signal, &recvqueue_lock);
+			}
+			for(i=0;i<result.nr;i++) {
+				if(main_loop) {
+					broadcast_queue(result.messages[i].protoname, result.messages[i].json);
+				}
+				json_delete(result.messages[i].json);
+			}
+			recvqueue_done++;
+			pthread_mutex_unlock(&recvqueue_lock);
+			pthread_cond_broadcast(&recvqueue_signal);
+		}
+	}
+	return (void *)NULL;
+}
 
-				if((protocol->hwtype == recvqueue->hwtype || protocol->hwtype == -1 || recvqueue->hwtype == -1) &&
-				   ((((protocol->parseRaw || protocol->parseCode) &&
-					  (protocol->rawlen > 0 || (protocol->minrawlen > 0 && protocol->maxrawlen > 0)))
-					   || protocol->parseBinary) && protocol->pulse > 0 && protocol->plslen)) {
-					plslengths = protocol->plslen;
-					while(plslengths && main_loop) {
-						if((recvqueue->plslen >= ((double)plslengths->length-5) &&
-						    recvqueue->plslen <= ((double)plslengths->length+5))) {
-							match = 1;
-							break;
-						}
-						plslengths = plslengths->next;
-					}
-					if((recvqueue->rawlen == protocol->rawlen || (
-					   (protocol->minrawlen > 0 && protocol->maxrawlen > 0 &&
-					    recvqueue->rawlen >= protocol->minrawlen && recvqueue->rawlen <= protocol->maxrawlen)))
-					    && match == 1) {
-						for(x=0;x<(int)recvqueue->rawlen;x++) {
-							if(x < 254) {
-								memcpy(&protocol->raw[x], &recvqueue->raw[x], sizeof(int));
-							}
-						}
-						if(protocol->parseRaw) {
-							logprintf(LOG_DEBUG, "recevied pulse length of %d", recvqueue->plslen);
-							logprintf(LOG_DEBUG, "called %s parseRaw()", protocol->id);
-							protocol->parseRaw();
-							protocol->repeats = -1;
-							receiver_create_message(protocol);
-						}
+/* A code is send in send_repeat bursts of txrpt repeats */
+static int send_burst_length(struct protocol_t *protocol, int rawlen) {
+	return (rawlen*protocol->txrpt)+1;
+}
 
-						/* Convert the raw codes to one's and zero's */
-						for(x=0;x<recvqueue->rawlen;x++) {
-							protocol->pCode[x] = protocol->code[x];
+/* Expand a code into zero terminated bursts */
+static void send_bursts(struct protocol_t *protocol, int *longcode, int *code, int rawlen) {
+	int burst_len = send_burst_length(protocol, rawlen), i = 0, x = 0;
 
-							if(protocol->raw[x] >= (plslengths->length * (1+protocol->pulse)/2)) {
-								protocol->code[x] = 1;
-							} else {
-								protocol->code[x] = 0;
-							}
-							/* Check if the current code matches the previous one */
-							// if(protocol->pCode[x] != protocol->code[x]) {
-								// protocol->repeats = 0;
-								// protocol->first = 0;
-								// protocol->second = 0;
-							// }
-						}
+	for(i=0;i<send_repeat;i++) {
+		for(x=0;x<protocol->txrpt;x++) {
+			memcpy(&longcode[(burst_len*i)+(rawlen*x)], code, sizeof(int)*(size_t)rawlen);
+		}
+		longcode[(burst_len*i)+burst_len-1] = 0;
+	}
+}
 
-						gettimeofday(&tv, NULL);
-						if(protocol->first > 0) {
-							protocol->first = protocol->second;
-						}
-						protocol->second = 1000000 * (unsigned int)tv.tv_sec + (unsigned int)tv.tv_usec;
-						if(protocol->first == 0) {
-							protocol->first = protocol->second;
-						}
+static unsigned int sendcache_hash(const char *key) {
+	unsigned int hash = 5381;
+	while(*key) {
+		hash = ((hash << 5) + hash) + (unsigned char)*key++;
+	}
+	return hash;
+}
 
-						/* Reset # of repeats after a certain delay */
-						if(((int)protocol->second-(int)protocol->first) > 500000) {
-							protocol->repeats = 0;
-						}
+static void sendcache_free(struct sendcache_t *node) {
+	sfree((void *)&node->key);
+	sfree((void *)&node->longcode);
+	if(node->message) {
+		sfree((void *)&node->message);
+	}
+	sfree((void *)&node->settings);
+	sfree((void *)&node);
+}
 
-						protocol->repeats++;
-						/* Continue if we have recognized enough repeated codes */
-						if(protocol->repeats >= (receive_repeat*protocol->rxrpt) ||
-						   strcmp(protocol->id, "pilight_firmware") == 0) {
-							if(protocol->parseCode) {
-								logprintf(LOG_DEBUG, "caught minimum # of repeats %d of %s", protocol->repeats, protocol->id);
-								logprintf(LOG_DEBUG, "called %s parseCode()", protocol->id);
-								protocol->parseCode();
-								receiver_create_message(protocol);
-							}
+/* Lookup a code and take a reference when found */
+static struct sendcache_t *sendcache_get(struct protocol_t *protocol, const char *key) {
+	struct sendcache_t *tmp = NULL, *prev = NULL;
+	unsigned int hash = sendcache_hash(key);
 
-							if(protocol->parseBinary) {
-								/* Convert the one's and zero's into binary */
-								for(x=0; x<(int)recvqueue->rawlen; x+=4) {
-									if(protocol->code[x+protocol->lsb] == 1) {
-										protocol->binary[x/4] = 1;
-									} else {
-										protocol->binary[x/4] = 0;
-									}
-								}
+	pthread_mutex_lock(&sendcache_lock);
+	tmp = sendcache;
+	while(tmp) {
+		if(tmp->hash == hash && tmp->protocol == protocol && strcmp(tmp->key, key) == 0) {
+			/* Keep the most recently used codes in front */
+			if(prev) {
+				prev->next = tmp->next;
+				tmp->next = sendcache;
+				sendcache = tmp;
+			}
+			tmp->refcount++;
+			break;
+		}
+		prev = tmp;
+		tmp = tmp->next;
+	}
+	pthread_mutex_unlock(&sendcache_lock);
+	return tmp;
+}
 
-								if((double)protocol->raw[1]/((plslengths->length * (1+protocol->pulse)/2)) < 2.1) {
-									x -= 4;
-								}
+static void sendcache_release(struct sendcache_t *node) {
+	pthread_mutex_lock(&sendcache_lock);
+	node->refcount--;
+	if(node->refcount == 0 && node->cached == 0) {
+		sendcache_free(node);
+	}
+	pthread_mutex_unlock(&sendcache_lock);
+}
+
+/* Expand the repeats of a cached code the first time it's needed */
+static int *sendcache_longcode(struct sendcache_t *node) {
+	pthread_mutex_lock(&sendcache_lock);
+	if(!node->longcode) {
+		if(!(node->longcode = malloc(sizeof(int)*(size_t)send_burst_length(node->protocol, node->rawlen)*(size_t)send_repeat))) {
+			logprintf(LOG_ERR, "out of memory");
+			exit(EXIT_FAILURE);
+		}
+		send_bursts(node->protocol, node->longcode, node->code, node->rawlen);
+	}
+	pthread_mutex_unlock(&sendcache_lock);
+	return node->longcode;
+}
 
-								/* Check if the binary matches the binary length */
-								if((protocol->binlen > 0 && ((x/4) == protocol->binlen))
-								   || (protocol->binlen == 0 && ((x/4) == protocol->rawlen/4))) {
-									logprintf(LOG_DEBUG, "called %s parseBinary()", protocol->id);
+/* Store a newly created code and return it with a reference taken */
+static struct sendcache_t *sendcache_add(struct protocol_t *protocol, const char *key, int *code, int rawlen, char *message, char *settings) {
+	struct sendcache_t *node = NULL, *tmp = NULL, *prev = NULL;
 
-									protocol->parseBinary();
-									receiver_create_message(protocol);
-								}
-							}
-						}
+	if(!(node = malloc(sizeof(struct sendcache_t)))) {
+		logprintf(LOG_ERR, "out of memory");
+		exit(EXIT_FAILURE);
+	}
+	if(!(node->key = malloc(strlen(key)+1))) {
+		logprintf(LOG_ERR, "out of memory");
+		exit(EXIT_FAILURE);
+	}
+	strcpy(node->key, key);
+	node->message = NULL;
+	if(message) {
+		if(!(node->message = malloc(strlen(message)+1))) {
+			logprintf(LOG_ERR, "out of memory");
+			exit(EXIT_FAILURE);
+		}
+		strcpy(node->message, message);
+	}
+	if(!(node->settings = malloc(strlen(settings)+1))) {
+		logprintf(LOG_ERR, "out of memory");
+		exit(EXIT_FAILURE);
+	}
+	strcpy(node->settings, settings);
+	node->longcode = NULL;
+	memcpy(node->code, code, sizeof(int)*(size_t)rawlen);
+	node->rawlen = rawlen;
+	node->hash = sendcache_hash(key);
+	node->protocol = protocol;
+	node->refcount = 1;
+	node->cached = 1;
+
+	pthread_mutex_lock(&sendcache_lock);
+	node->next = sendcache;
+	sendcache = node;
+	sendcache_number++;
+	/* Drop the least recently used code */
+	if(sendcache_number > SEND_CACHE_SIZE) {
+		tmp = sendcache;
+		while(tmp->next) {
+			prev = tmp;
+			tmp = tmp->next;
+		}
+		prev->next = NULL;
+		sendcache_number--;
+		tmp->cached = 0;
+		if(tmp->refcount == 0) {
+			sendcache_free(tmp);
+		}
+	}
+	pthread_mutex_unlock(&sendcache_lock);
+
+	return node;
+}
+
+/* Codes still queued are freed when they are send */
+static void sendcache_clear(void) {
+	struct sendcache_t *tmp = NULL;
+
+	pthread_mutex_lock(&sendcache_lock);
+	while(sendcache) {
+		tmp = sendcache;
+		sendcache = sendcache->next;
+		tmp->cached = 0;
+		if(tmp->refcount == 0) {
+			sendcache_free(tmp);
+		}
+	}
+	sendcache_number = 0;
+	pthread_mutex_unlock(&sendcache_lock);
+}
+
+static void sendqueue_free(struct sendqueue_t *node) {
+	if(node->message) {
+		sfree((void *)&node->message);
+	}
+	if(node->settings) {
+		sfree((void *)&node->settings);
+	}
+	if(node->device) {
+		sfree((void *)&node->device);
+	}
+	sfree((void *)&node->protoname);
+	if(node->cache) {
+		sendcache_release(node->cache);
+	}
+	queue_free(sendqueue_nodes, node);
+}
+
+/* Should be called with the sendqueue_lock held. A queued code for
+   the same device is superseded by the new one, which takes over its
+   place in the queue when both have the same priority. */
+static void sendqueue_push(struct sendqueue_t *mnode) {
+	struct sendqueue_t *tmp = NULL, *prev = NULL;
+	int p = 0;
+
+	if(mnode->device) {
+		for(p=0;p<SEND_PRIORITIES;p++) {
+			prev = NULL;
+			tmp = sendqueue[p];
+			while(tmp) {
+				if(tmp->protopt == mnode->protopt && tmp->device && strcmp(tmp->device, mnode->device) == 0) {
+					break;
+				}
+				prev = tmp;
+				tmp = tmp->next;
+			}
+			if(tmp) {
+				logprintf(LOG_DEBUG, "superseded queued %s code", tmp->protoname);
+				sendqueue_coalesced++;
+				if(p == mnode->priority) {
+					mnode->next = tmp->next;
+					if(prev) {
+						prev->next = mnode;
+					} else {
+						sendqueue[p] = mnode;
+					}
+					if(sendqueue_head[p] == tmp) {
+						sendqueue_head[p] = mnode;
 					}
+					sendqueue_free(tmp);
+					return;
+				}
+				if(prev) {
+					prev->next = tmp->next;
+				} else {
+					sendqueue[p] = tmp->next;
 				}
-				pnode = pnode->next;
+				if(sendqueue_head[p] == tmp) {
+					sendqueue_head[p] = prev;
+				}
+				sendqueue_number--;
+				sendqueue_free(tmp);
+				break;
 			}
+		}
+	}
 
-			struct recvqueue_t *tmp = recvqueue;
-			recvqueue = recvqueue->next;
-			sfree((void *)&tmp);
-			recvqueue_number--;
-			pthread_mutex_unlock(&recvqueue_lock);
-		} else {
-			pthread_cond_wait(&recvqueue_signal, &recvqueue_lock);
+	mnode->next = NULL;
+	if(sendqueue[mnode->priority] == NULL) {
+		sendqueue[mnode->priority] = mnode;
+	} else {
+		sendqueue_head[mnode->priority]->next = mnode;
+	}
+	sendqueue_head[mnode->priority] = mnode;
+	sendqueue_number++;
+}
+
+static struct sendworker_t *send_worker_create(struct hardware_t *hw) {
+	struct sendworker_t *worker = malloc(sizeof(struct sendworker_t));
+	if(!worker) {
+		logprintf(LOG_ERR, "out of memory");
+		exit(EXIT_FAILURE);
+	}
+	worker->hardware = hw;
+	worker->node = NULL;
+	pthread_mutex_lock(&sendqueue_lock);
+	worker->next = sendworkers;
+	sendworkers = worker;
+	pthread_mutex_unlock(&sendqueue_lock);
+	return worker;
+}
+
+/* Should be called with the sendqueue_lock held */
+static int send_worker_accepts(struct sendworker_t *worker, struct sendqueue_t *node) {
+	struct sendworker_t *tmp = sendworkers;
+
+	if(worker->hardware) {
+		return (worker->hardware->type == node->protopt->hwtype);
+	}
+	while(tmp) {
+		if(tmp->hardware && tmp->hardware->type == node->protopt->hwtype) {
+			return 0;
 		}
+		tmp = tmp->next;
 	}
-	return (void *)NULL;
+	return 1;
+}
+
+/* Should be called with the sendqueue_lock held. Codes for a device
+   that is still being send to by another transmitter have to wait,
+   so the states are send in order. */
+static int send_worker_busy(struct sendqueue_t *node) {
+	struct sendworker_t *tmp = sendworkers;
+
+	if(node->device) {
+		while(tmp) {
+			if(tmp->node && tmp->node->protopt == node->protopt && tmp->node->device &&
+			   strcmp(tmp->node->device, node->device) == 0) {
+				return 1;
+			}
+			tmp = tmp->next;
+		}
+	}
+	return 0;
+}
+
+/* Should be called with the sendqueue_lock held */
+static struct sendqueue_t *sendqueue_pop(struct sendworker_t *worker) {
+	struct sendqueue_t *node = NULL, *prev = NULL;
+	unsigned long long wait = 0;
+	int p = 0;
+
+	for(p=0;p<SEND_PRIORITIES;p++) {
+		prev = NULL;
+		node = sendqueue[p];
+		while(node) {
+			if(send_worker_accepts(worker, node) == 1 && send_worker_busy(node) == 0) {
+				break;
+			}
+			prev = node;
+			node = node->next;
+		}
+		if(node) {
+			if(prev) {
+				prev->next = node->next;
+			} else {
+				sendqueue[p] = node->next;
+			}
+			if(sendqueue_head[p] == node) {
+				sendqueue_head[p] = prev;
+			}
+			sendqueue_number--;
+			queue_dequeued(sendqueue_nodes, node);
+
+			wait = hardware_timestamp() - node->queued;
+			sendqueue_wait += wait;
+			sendqueue_waited++;
+			if(wait > sendqueue_wait_max) {
+				sendqueue_wait_max = wait;
+			}
+			worker->node = node;
+			break;
+		}
+	}
+	return node;
+}
+
+static void send_airtime(struct hardware_t *hw, unsigned long long airtime) {
+	struct sendairtime_t *tmp = NULL;
+
+	pthread_mutex_lock(&sendqueue_lock);
+	tmp = sendairtime;
+	while(tmp) {
+		if(tmp->hardware == hw) {
+			break;
+		}
+		tmp = tmp->next;
+	}
+	if(!tmp) {
+		if(!(tmp = malloc(sizeof(struct sendairtime_t)))) {
+			logprintf(LOG_ERR, "out of memory");
+			exit(EXIT_FAILURE);
+		}
+		tmp->hardware = hw;
+		tmp->airtime = 0;
+		tmp->sends = 0;
+		tmp->next = sendairtime;
+		sendairtime = tmp;
+	}
+	tmp->airtime += airtime;
+	tmp->sends++;
+	pthread_mutex_unlock(&sendqueue_lock);
+}
+
+/* Add the queue depth, the wait times and the share of airtime of
+   every transmitter since the previous report to the values */
+static void send_queue_report(JsonNode *code) {
+	struct sendairtime_t *tmp = NULL;
+	unsigned long long now = hardware_timestamp(), period = 0;
+	char name[255];
+
+	pthread_mutex_lock(&sendqueue_lock);
+	period = now - sendqueue_reported;
+	json_append_member(code, "send-queue", json_mknumber(sendqueue_number));
+	if(sendqueue_waited > 0) {
+		json_append_member(code, "send-wait", json_mknumber((double)(sendqueue_wait/sendqueue_waited)/1000000.0));
+		json_append_member(code, "send-wait-max", json_mknumber((double)sendqueue_wait_max/1000000.0));
+	}
+	json_append_member(code, "send-coalesced", json_mknumber((double)sendqueue_coalesced));
+	tmp = sendairtime;
+	while(tmp) {
+		if(sendqueue_reported > 0 && period > 0) {
+			snprintf(name, sizeof(name), "airtime-%s", tmp->hardware->id);
+			json_append_member(code, name, json_mknumber((double)tmp->airtime*100.0/(double)period));
+		}
+		tmp->airtime = 0;
+		tmp = tmp->next;
+	}
+	sendqueue_wait = 0;
+	sendqueue_wait_max = 0;
+	sendqueue_waited = 0;
+	sendqueue_reported = now;
+	pthread_mutex_unlock(&sendqueue_lock);
+}
+
+static void sendqueue_gc(void) {
+	struct sendqueue_t *node = NULL;
+	struct sendairtime_t *tmp = NULL;
+	struct sendworker_t *worker = NULL;
+	int p = 0;
+
+	pthread_mutex_lock(&sendqueue_lock);
+	for(p=0;p<SEND_PRIORITIES;p++) {
+		while(sendqueue[p]) {
+			node = sendqueue[p];
+			sendqueue[p] = node->next;
+			sendqueue_free(node);
+		}
+		sendqueue_head[p] = NULL;
+	}
+	sendqueue_number = 0;
+	while(sendairtime) {
+		tmp = sendairtime;
+		sendairtime = sendairtime->next;
+		sfree((void *)&tmp);
+	}
+	while(sendworkers) {
+		worker = sendworkers;
+		sendworkers = sendworkers->next;
+		sfree((void *)&worker);
+	}
+	pthread_mutex_unlock(&sendqueue_lock);
 }
 
 void *send_code(void *param) {
-	int i = 0, x = 0;
+	struct sendworker_t *worker = (struct sendworker_t *)param;
+	int i = 0, ret = 0;
+	unsigned long long start = 0;
+	struct sendqueue_t *node = NULL;
 	struct sched_param sched;
 
 	/* Make sure the pilight sender gets
@@ -613,121 +1281,170 @@ void *send_code(void *param) {
 	pthread_mutex_lock(&sendqueue_lock);
 
 	while(main_loop) {
-		if(sendqueue_number > 0) {
-			sending = 1;
-			pthread_mutex_lock(&sendqueue_lock);
-			pthread_mutex_lock(&receive_lock);
+		if(sendqueue_number > 0 && (node = sendqueue_pop(worker)) != NULL) {
+			/* Don't block new codes from being queued while sending */
+			pthread_mutex_unlock(&sendqueue_lock);
 
-			struct protocol_t *protocol = sendqueue->protopt;
-			struct hardware_t *hw = NULL;
+			struct protocol_t *protocol = node->protopt;
+			struct hardware_t *hw = worker->hardware;
 
 			JsonNode *message = NULL;
 
-			if(sendqueue->message && strcmp(sendqueue->message, "{}") != 0) {
-				if(json_validate(sendqueue->message) == true) {
+			if(node->message && strcmp(node->message, "{}") != 0) {
+				if(json_validate(node->message) == true) {
 					if(!message) {
 						message = json_mkobject();
 					}
 					json_append_member(message, "origin", json_mkstring("sender"));
 					json_append_member(message, "protocol", json_mkstring(protocol->id));
-					json_append_member(message, "message", json_decode(sendqueue->message));
-					if(strlen(sendqueue->uuid) > 0) {
-						json_append_member(message, "uuid", json_mkstring(sendqueue->uuid));
+					json_append_member(message, "message", json_decode(node->message));
+					if(strlen(node->uuid) > 0) {
+						json_append_member(message, "uuid", json_mkstring(node->uuid));
 					}
 					json_append_member(message, "repeat", json_mknumber(1));
 				}
 			}
-			if(sendqueue->settings && strcmp(sendqueue->settings, "{}") != 0) {
-				if(json_validate(sendqueue->settings) == true) {
+			if(node->settings && strcmp(node->settings, "{}") != 0) {
+				if(json_validate(node->settings) == true) {
 					if(!message) {
 						message = json_mkobject();
 					}
-					json_append_member(message, "settings", json_decode(sendqueue->settings));
+					json_append_member(message, "settings", json_decode(node->settings));
 				}
 			}
 
-			/* Create a single code with all repeats included */
-			int code_len = (protocol->rawlen*send_repeat*protocol->txrpt)+1;
-			size_t send_len = (size_t)(code_len * (int)sizeof(int));
-			int longCode[code_len];
-			memset(longCode, 0, send_len);
-
-			for(i=0;i<(send_repeat*protocol->txrpt);i++) {
-				for(x=0;x<protocol->rawlen;x++) {
-					longCode[x+(protocol->rawlen*i)]=sendqueue->code[x];
-				}
-			}
+			/* Hardware modules that repeat a code themselves
+			   get it as is, for the others the bursts with all
+			   repeats included are created */
+			int burst_len = send_burst_length(protocol, node->rawlen);
+			int *longCode = NULL;
+			int *sendCode = NULL;
 
-			longCode[code_len] = 0;
-			struct conf_hardware_t *tmp_confhw = conf_hardware;
-			while(tmp_confhw) {
-				if(protocol->hwtype == tmp_confhw->hardware->type) {
-					hw = tmp_confhw->hardware;
-					break;
+			if(hw && hw->send && !hw->sendRepeat) {
+				if(node->cache) {
+					sendCode = sendcache_longcode(node->cache);
+				} else {
+					if(!(longCode = malloc(sizeof(int)*(size_t)burst_len*(size_t)send_repeat))) {
+						logprintf(LOG_ERR, "out of memory");
+						exit(EXIT_FAILURE);
+					}
+					send_bursts(protocol, longCode, node->code, node->rawlen);
+					sendCode = longCode;
 				}
-				tmp_confhw = tmp_confhw->next;
 			}
 
 			if(hw && hw->send) {
 				logprintf(LOG_DEBUG, "**** RAW CODE ****");
 				if(log_level_get() >= LOG_DEBUG) {
-					for(i=0;i<protocol->rawlen;i++) {
-						printf("%d ", protocol->raw[i]);
+					for(i=0;i<node->rawlen;i++) {
+						printf("%d ", node->code[i]);
 					}
 					printf("\n");
 				}
 				logprintf(LOG_DEBUG, "**** RAW CODE ****");
-				if(hw->send(longCode) == 0) {
+				/* The receivers only ignore what they hear during the
+				   bursts, so codes send by others in between still
+				   get through */
+				for(i=0;i<send_repeat;i++) {
+					receive_echo_open(hw);
+					start = hardware_timestamp();
+					if(hw->sendRepeat) {
+						ret = hw->sendRepeat(node->code, node->rawlen, protocol->txrpt);
+					} else {
+						ret = hw->send(&sendCode[burst_len*i]);
+					}
+					send_airtime(hw, hardware_timestamp()-start);
+					receive_echo_close(hw);
+					if(ret != 0) {
+						break;
+					}
+				}
+				if(ret == 0) {
 					logprintf(LOG_DEBUG, "successfully send %s code", protocol->id);
 					if(strcmp(protocol->id, "raw") == 0) {
-						int plslen = protocol->raw[protocol->rawlen-1]/PULSE_DIV;
-						receive_queue(protocol->raw, protocol->rawlen, plslen, -1);
+						int plslen = node->code[node->rawlen-1]/PULSE_DIV;
+						receive_queue(node->code, node->rawlen, plslen, -1);
 					}
 				} else {
 					logprintf(LOG_ERR, "failed to send code");
 				}
 			} else {
 				if(strcmp(protocol->id, "raw") == 0) {
-					int plslen = protocol->raw[protocol->rawlen-1]/PULSE_DIV;
-					receive_queue(protocol->raw, protocol->rawlen, plslen, -1);
+					int plslen = node->code[node->rawlen-1]/PULSE_DIV;
+					receive_queue(node->code, node->rawlen, plslen, -1);
 				}
 			}
 
+			if(longCode) {
+				sfree((void *)&longCode);
+			}
+
 			if(message) {
-				broadcast_queue(sendqueue->protoname, message);
+				broadcast_queue(node->protoname, message);
 				json_delete(message);
 				message = NULL;
 			}
 
-			struct sendqueue_t *tmp = sendqueue;
-			if(tmp->message) {
-				sfree((void *)&tmp->message);
-			}
-			if(tmp->settings) {
-				sfree((void *)&tmp->settings);
-			}
-			sfree((void *)&tmp->protoname);
-			sendqueue = sendqueue->next;
-			sfree((void *)&tmp);
-			sendqueue_number--;
-			sending = 0;
-			pthread_mutex_unlock(&sendqueue_lock);
-			pthread_mutex_unlock(&receive_lock);
-			pthread_cond_signal(&receive_signal);
+			sendqueue_free(node);
+			pthread_mutex_lock(&sendqueue_lock);
+			worker->node = NULL;
+			/* Codes for the same device can be picked up again */
+			pthread_cond_broadcast(&sendqueue_signal);
 		} else {
 			pthread_cond_wait(&sendqueue_signal, &sendqueue_lock);
 		}
 	}
+	pthread_mutex_unlock(&sendqueue_lock);
 	return (void *)NULL;
 }
 
+/* Identifies the device a code is send to by the id
+   values of the protocol, e.g. "id=123;unit=1;" */
+static char *send_device(struct protocol_t *protocol, JsonNode *jcode) {
+	struct options_t *tmp_options = protocol->options;
+	char key[1024], *device = NULL, *stmp = NULL;
+	double itmp = 0;
+	size_t len = 0;
+	int n = 0;
+
+	key[0] = '\0';
+	while(tmp_options) {
+		if(tmp_options->conftype == CONFIG_ID) {
+			n = 0;
+			if(tmp_options->vartype == JSON_NUMBER && json_find_number(jcode, tmp_options->name, &itmp) == 0) {
+				n = snprintf(&key[len], sizeof(key)-len, "%s=%g;", tmp_options->name, itmp);
+			} else if(tmp_options->vartype == JSON_STRING && json_find_string(jcode, tmp_options->name, &stmp) == 0) {
+				n = snprintf(&key[len], sizeof(key)-len, "%s=%s;", tmp_options->name, stmp);
+			}
+			if(n < 0 || (size_t)n >= sizeof(key)-len) {
+				return NULL;
+			}
+			len += (size_t)n;
+		}
+		tmp_options = tmp_options->next;
+	}
+	if(len == 0) {
+		return NULL;
+	}
+	if(!(device = malloc(len+1))) {
+		logprintf(LOG_ERR, "out of memory");
+		exit(EXIT_FAILURE);
+	}
+	strcpy(device, key);
+	return device;
+}
+
 /* Send a specific code */
-static void send_queue(JsonNode *json) {
-	int match = 0, x = 0;
+static void send_queue(JsonNode *json, int priority) {
+	int match = 0, x = 0, ret = 0, rawlen = 0, fresh = 0;
 	struct timeval tcurrent;
-	char *uuid = NULL;
+	struct sendcache_t *cache = NULL;
+	char *uuid = NULL, *key = NULL, *message = NULL, *settings = NULL, *device = NULL;
+	int *code = NULL;
 	/* Hold the final protocol struct */
 	struct protocol_t *protocol = NULL;
+	/* Holds the code created by the protocol */
+	struct protocol_decode_t decode;
 	struct sched_param sched;
 
 	/* Make sure the pilight sender gets
@@ -748,7 +1465,7 @@ static void send_queue(JsonNode *json) {
 		json_delete(jcode);
 	} else {
 		json_find_string(jcode, "uuid", &uuid);
-		/* If we matched a protocol and are not already sending, continue */
+		/* If we matched a protocol, continue */
 		if((!uuid || (uuid && strcmp(uuid, pilight_uuid) == 0)) && send_repeat > 0) {
 			jprotocol = json_first_child(jprotocols);
 			while(jprotocol && match == 0) {
@@ -769,42 +1486,41 @@ static void send_queue(JsonNode *json) {
 				jprotocol = jprotocol->next;
 			}
 			if(match == 1 && protocol->createCode) {
-				/* Let the protocol create his code */
-				if(protocol->createCode(jcode) == 0) {
-					pthread_mutex_lock(&sendqueue_lock);
-					if(sendqueue_number <= 1024) {
-						struct sendqueue_t *mnode = malloc(sizeof(struct sendqueue_t));
-						if(!mnode) {
-							logprintf(LOG_ERR, "out of memory");
-							exit(EXIT_FAILURE);
-						}
-						gettimeofday(&tcurrent, NULL);
-						mnode->id = 1000000 * (unsigned int)tcurrent.tv_sec + (unsigned int)tcurrent.tv_usec;
-						mnode->message = NULL;
-						if(protocol->message) {
-							char *jsonstr = json_stringify(protocol->message, NULL);
-							json_delete(protocol->message);
+				/* Only the codes send by a transmitter are the same on every send */
+				if(protocol->hwtype == RF433 || protocol->hwtype == RF868) {
+					key = json_stringify(jcode, NULL);
+					cache = sendcache_get(protocol, key);
+				}
+				decode.message = NULL;
+				if(cache) {
+					logprintf(LOG_DEBUG, "using cached %s code", protocol->id);
+					ret = 0;
+					code = cache->code;
+					rawlen = cache->rawlen;
+					message = cache->message;
+					settings = cache->settings;
+				} else {
+					/* Let the protocol create his code */
+					fresh = 1;
+					protocol_bind(protocol, &decode);
+					ret = protocol->createCode(jcode);
+					decode.rawlen = protocol->rawlen;
+					protocol_unbind(protocol, &decode);
+					if(ret == 0) {
+						if(decode.message) {
+							char *jsonstr = json_stringify(decode.message, NULL);
+							json_delete(decode.message);
 							if(json_validate(jsonstr) == true) {
-								mnode->message = malloc(strlen(jsonstr)+1);
-								if(!mnode->message) {
+								message = malloc(strlen(jsonstr)+1);
+								if(!message) {
 									logprintf(LOG_ERR, "out of memory");
 									exit(EXIT_FAILURE);
 								}
-								strcpy(mnode->message, jsonstr);
+								strcpy(message, jsonstr);
 							}
 							sfree((void *)&jsonstr);
-							protocol->message = NULL;
-						}
-						for(x=0;x<protocol->rawlen;x++) {
-							mnode->code[x]=protocol->raw[x];
-						}
-						mnode->protoname = malloc(strlen(protocol->id)+1);
-						if(!mnode->protoname) {
-							logprintf(LOG_ERR, "out of memory");
-							exit(EXIT_FAILURE);
+							decode.message = NULL;
 						}
-						strcpy(mnode->protoname, protocol->id);
-						mnode->protopt = protocol;
 
 						struct options_t *tmp_options = protocol->options;
 						double itmp = 0;
@@ -820,30 +1536,85 @@ static void send_queue(JsonNode *json) {
 							}
 							tmp_options = tmp_options->next;
 						}
-						char *strsett = json_stringify(jsettings, NULL);
-						mnode->settings = malloc(strlen(strsett)+1);
-						strcpy(mnode->settings, strsett);
-						sfree((void *)&strsett);
+						settings = json_stringify(jsettings, NULL);
 						json_delete(jsettings);
 
+						code = decode.raw;
+						rawlen = decode.rawlen;
+						if(key && rawlen > 0) {
+							cache = sendcache_add(protocol, key, code, rawlen, message, settings);
+						}
+					}
+				}
+				if(ret == 0) {
+					device = send_device(protocol, jcode);
+					pthread_mutex_lock(&sendqueue_lock);
+					struct sendqueue_t *mnode = NULL;
+					if((mnode = queue_alloc(sendqueue_nodes)) != NULL) {
+						gettimeofday(&tcurrent, NULL);
+						mnode->id = 1000000 * (unsigned int)tcurrent.tv_sec + (unsigned int)tcurrent.tv_usec;
+						mnode->message = NULL;
+						if(message) {
+							mnode->message = malloc(strlen(message)+1);
+							if(!mnode->message) {
+								logprintf(LOG_ERR, "out of memory");
+								exit(EXIT_FAILURE);
+							}
+							strcpy(mnode->message, message);
+						}
+						for(x=0;x<rawlen;x++) {
+							mnode->code[x]=code[x];
+						}
+						mnode->rawlen = rawlen;
+						mnode->protoname = malloc(strlen(protocol->id)+1);
+						if(!mnode->protoname) {
+							logprintf(LOG_ERR, "out of memory");
+							exit(EXIT_FAILURE);
+						}
+						strcpy(mnode->protoname, protocol->id);
+						mnode->protopt = protocol;
+						mnode->settings = malloc(strlen(settings)+1);
+						if(!mnode->settings) {
+							logprintf(LOG_ERR, "out of memory");
+							exit(EXIT_FAILURE);
+						}
+						strcpy(mnode->settings, settings);
+						/* The queued code holds its own reference */
+						mnode->cache = cache;
+						cache = NULL;
+						mnode->device = device;
+						device = NULL;
+						mnode->priority = priority;
+						mnode->queued = hardware_timestamp();
+
 						if(uuid) {
 							strcpy(mnode->uuid, uuid);
 						} else {
 							memset(mnode->uuid, '\0', UUID_LENGTH);
 						}
-						if(sendqueue_number == 0) {
-							sendqueue = mnode;
-							sendqueue_head = mnode;
-						} else {
-							sendqueue_head->next = mnode;
-							sendqueue_head = mnode;
-						}
-						sendqueue_number++;
+						sendqueue_push(mnode);
 					} else {
 						logprintf(LOG_ERR, "send queue full");
 					}
 					pthread_mutex_unlock(&sendqueue_lock);
-					pthread_cond_signal(&sendqueue_signal);
+					pthread_cond_broadcast(&sendqueue_signal);
+				}
+				if(cache) {
+					sendcache_release(cache);
+				}
+				/* The cache keeps its own copies */
+				if(fresh == 1) {
+					sfree((void *)&message);
+					sfree((void *)&settings);
+				}
+				if(decode.message) {
+					json_delete(decode.message);
+				}
+				if(key) {
+					sfree((void *)&key);
+				}
+				if(device) {
+					sfree((void *)&device);
 				}
 			}
 		}
@@ -854,8 +1625,14 @@ static void send_queue(JsonNode *json) {
 	}
 }
 
+static void send_queue_normal(JsonNode *json) {
+	send_queue(json, SEND_PRIORITY_NORMAL);
+}
+
 static void client_sender_parse_code(int i, JsonNode *json) {
 	int sd = socket_get_clients(i);
+	int prio = SEND_PRIORITY_NORMAL;
+	char *priority = NULL;
 
 	if(incognito_mode == 0 && i > -1 && handshakes[i] != NODE) {
 		/* Don't let the sender wait until we have send the code */
@@ -863,7 +1640,16 @@ static void client_sender_parse_code(int i, JsonNode *json) {
 		handshakes[i] = -1;
 	}
 
-	send_queue(json);
+	/* Scripts and polling can let manual control go first */
+	if(json_find_string(json, "priority", &priority) == 0) {
+		if(strcmp(priority, "high") == 0) {
+			prio = SEND_PRIORITY_HIGH;
+		} else if(strcmp(priority, "low") == 0) {
+			prio = SEND_PRIORITY_LOW;
+		}
+	}
+
+	send_queue(json, prio);
 }
 
 static void control_device(struct conf_devices_t *dev, char *state, JsonNode *values) {
@@ -959,7 +1745,7 @@ static void control_device(struct conf_devices_t *dev, char *state, JsonNode *va
 	json_append_member(json, "code", code);
 	json_append_member(json, "message", json_mkstring("send"));
 
-	send_queue(json);
+	send_queue(json, SEND_PRIORITY_HIGH);
 
 	json_delete(json);
 }
@@ -1014,6 +1800,16 @@ static void client_controller_parse_code(int i, JsonNode *json) {
 			socket_write(sd, output);
 			sfree((void *)&output);
 			json_delete(jsend);
+		/* Send the statistics of the internal queues */
+		} else if(strcmp(message, "request queues") == 0) {
+			struct JsonNode *jsend = json_mkobject();
+			struct JsonNode *jqueues = json_mkobject();
+			queue_stats(jqueues);
+			json_append_member(jsend, "queues", jqueues);
+			char *output = json_stringify(jsend, NULL);
+			socket_write(sd, output);
+			sfree((void *)&output);
+			json_delete(jsend);
 		/* Control a specific device */
 		} else if(strcmp(message, "send") == 0) {
 			/* Check if got a code */
@@ -1155,15 +1951,122 @@ static void client_webserver_parse_code(int i, char buffer[BUFFER_SIZE]) {
 }
 #endif
 
+/* Handle a message from a client, binary messages come in here directly */
+static void socket_parse_json(int i, JsonNode *json) {
+	int sd = socket_get_clients(i);
+	char *message = NULL;
+	char *incognito = NULL;
+	char *format = NULL;
+	short x = 0;
+
+	if(log_level_get() >= LOG_DEBUG && socket_get_binary(i) == 1) {
+		char *buffer = json_stringify(json, NULL);
+		logprintf(LOG_DEBUG, "socket recv: %s", buffer);
+		sfree((void *)&buffer);
+	}
+
+	/* The incognito mode is used by the daemon to emulate certain clients.
+	   Temporary change the client type from the node mode to the emulated
+	   client mode. */
+	if(json_find_string(json, "incognito", &incognito) == 0) {
+		incognito_mode = 1;
+		for(x=0;x<(sizeof(clients)/sizeof(clients[0]));x++) {
+			if(strcmp(clients[x], incognito) == 0) {
+				handshakes[i] = x;
+				break;
+			}
+		}
+	} else if(json_find_string(json, "message", &message) == 0) {
+		if(handshakes[i] != NODE && handshakes[i] != RECEIVER && handshakes[i] > -1) {
+			if(runmode == 2 && sockfd > 0 && strcmp(message, "request config") != 0) {
+				socket_write(sockfd, "{\"incognito\":\"%s\"}", clients[handshakes[i]]);
+				socket_write_json(sockfd, json);
+			}
+		}
+		if(handshakes[i] == NODE) {
+			client_node_parse_code(i, json);
+		} else if(handshakes[i] == SENDER) {
+			client_sender_parse_code(i, json);
+			if(strcmp(message, "send") == 0) {
+				for(x=0;x<(sizeof(clients)/sizeof(clients[0]));x++) {
+					if(handshakes[x] == NODE) {
+						socket_write(socket_get_clients(x), "{\"incognito\":\"sender\"}");
+						socket_write_json(socket_get_clients(x), json);
+					}
+				}
+			}
+		} else if(handshakes[i] == CONTROLLER || handshakes[i] == GUI) {
+			client_controller_parse_code(i, json);
+			if(strcmp(message, "send") == 0) {
+				for(x=0;x<(sizeof(clients)/sizeof(clients[0]));x++) {
+					if(handshakes[x] == NODE) {
+						socket_write(socket_get_clients(x), "{\"incognito\":\"controller\"}");
+						socket_write_json(socket_get_clients(x), json);
+					}
+				}
+			}
+		} else {
+			/* Check if we matched a know client type */
+			for(x=0;x<(sizeof(clients)/sizeof(clients[0]));x++) {
+				char *tmp = malloc(8+strlen(clients[x]));
+				if(!tmp) {
+					logprintf(LOG_ERR, "out of memory");
+					exit(EXIT_FAILURE);
+				}
+				sprintf(tmp, "client %s", clients[x]);
+				tmp[7+strlen(clients[x])] = '\0';
+				if(strcmp(message, tmp) == 0) {
+					/* Everything after the acceptance is binary */
+					if(json_find_string(json, "format", &format) == 0 && strcmp(format, "binary") == 0) {
+						socket_write(sd, "{\"message\":\"accept client\",\"format\":\"binary\"}");
+						socket_set_binary(sd);
+					} else {
+						socket_write(sd, "{\"message\":\"accept client\"}");
+					}
+					logprintf(LOG_INFO, "client recognized as %s", clients[x]);
+
+					handshakes[i] = x;
+
+					if(handshakes[i] == NODE) {
+						char *uuid = NULL;
+						if(json_find_string(json, "uuid", &uuid) == 0) {
+							node_add(i, uuid);
+						} else {
+							handshakes[i] = -1;
+						}
+					}
+					if(handshakes[i] == RECEIVER || handshakes[i] == GUI || handshakes[i] == NODE)
+						receivers++;
+					sfree((void *)&tmp);
+					break;
+				}
+				sfree((void *)&tmp);
+			}
+		}
+		/* Directly after using the incognito mode, restore the node mode */
+		if(incognito_mode == 1) {
+			for(x=0;x<(sizeof(clients)/sizeof(clients[0]));x++) {
+				if(strcmp(clients[x], "node") == 0) {
+					handshakes[i] = x;
+					break;
+				}
+			}
+			incognito_mode = 0;
+		}
+	}
+
+	if(handshakes[i] == -1 && socket_get_clients(i) > 0) {
+		socket_write(sd, "{\"message\":\"reject client\"}");
+		socket_close(sd);
+	}
+}
+
 /* Parse the incoming buffer from the client */
 static void socket_parse_data(int i, char *buffer) {
 	int sd = socket_get_clients(i);
 	struct sockaddr_in address;
 	int addrlen = sizeof(address);
-	char *message;
-	char *incognito;
 	JsonNode *json = NULL;
-	short x = 0;
 
 	getpeername(sd, (struct sockaddr*)&address, (socklen_t*)&addrlen);
 
@@ -1184,95 +2087,7 @@ static void socket_parse_data(int i, char *buffer) {
 		if(json_validate(buffer) == true) {
 #endif
 			json = json_decode(buffer);
-
-			/* The incognito mode is used by the daemon to emulate certain clients.
-			   Temporary change the client type from the node mode to the emulated
-			   client mode. */
-			if(json_find_string(json, "incognito", &incognito) == 0) {
-				incognito_mode = 1;
-				for(x=0;x<(sizeof(clients)/sizeof(clients[0]));x++) {
-					if(strcmp(clients[x], incognito) == 0) {
-						handshakes[i] = x;
-						break;
-					}
-				}
-			} else if(json_find_string(json, "message", &message) == 0) {
-				if(handshakes[i] != NODE && handshakes[i] != RECEIVER && handshakes[i] > -1) {
-					if(runmode == 2 && sockfd > 0 && strcmp(message, "request config") != 0) {
-						socket_write(sockfd, "{\"incognito\":\"%s\"}", clients[handshakes[i]]);
-						socket_write(sockfd, buffer);
-					}
-				}
-				if(handshakes[i] == NODE) {
-					client_node_parse_code(i, json);
-				} else if(handshakes[i] == SENDER) {
-					client_sender_parse_code(i, json);
-					if(strcmp(message, "send") == 0) {
-						for(x=0;x<(sizeof(clients)/sizeof(clients[0]));x++) {
-							if(handshakes[x] == NODE) {
-								socket_write(socket_get_clients(x), "{\"incognito\":\"sender\"}");
-								socket_write(socket_get_clients(x), buffer);
-							}
-						}
-					}
-				} else if(handshakes[i] == CONTROLLER || handshakes[i] == GUI) {
-					client_controller_parse_code(i, json);
-					if(strcmp(message, "send") == 0) {
-						for(x=0;x<(sizeof(clients)/sizeof(clients[0]));x++) {
-							if(handshakes[x] == NODE) {
-								socket_write(socket_get_clients(x), "{\"incognito\":\"controller\"}");
-								socket_write(socket_get_clients(x), buffer);
-							}
-						}
-					}
-				} else {
-					/* Check if we matched a know client type */
-					for(x=0;x<(sizeof(clients)/sizeof(clients[0]));x++) {
-						char *tmp = malloc(8+strlen(clients[x]));
-						if(!tmp) {
-							logprintf(LOG_ERR, "out of memory");
-							exit(EXIT_FAILURE);
-						}
-						sprintf(tmp, "client %s", clients[x]);
-						tmp[7+strlen(clients[x])] = '\0';
-						if(strcmp(message, tmp) == 0) {
-							socket_write(sd, "{\"message\":\"accept client\"}");
-							logprintf(LOG_INFO, "client recognized as %s", clients[x]);
-
-							handshakes[i] = x;
-
-							if(handshakes[i] == NODE) {
-								char *uuid = NULL;
-								if(json_find_string(json, "uuid", &uuid) == 0) {
-									node_add(i, uuid);
-								} else {
-									handshakes[i] = -1;
-								}
-							}
-							if(handshakes[i] == RECEIVER || handshakes[i] == GUI || handshakes[i] == NODE)
-								receivers++;
-							sfree((void *)&tmp);
-							break;
-						}
-						sfree((void *)&tmp);
-					}
-				}
-				/* Directly after using the incognito mode, restore the node mode */
-				if(incognito_mode == 1) {
-					for(x=0;x<(sizeof(clients)/sizeof(clients[0]));x++) {
-						if(strcmp(clients[x], "node") == 0) {
-							handshakes[i] = x;
-							break;
-						}
-					}
-					incognito_mode = 0;
-				}
-			}
-
-			if(handshakes[i] == -1 && socket_get_clients(i) > 0) {
-				socket_write(sd, "{\"message\":\"reject client\"}");
-				socket_close(sd);
-			}
+			socket_parse_json(i, json);
 		}
 	}
 	if(json) {
@@ -1281,6 +2096,11 @@ static void socket_parse_data(int i, char *buffer) {
 	}
 }
 
+static void socket_client_connected(int i) {
+	/* Not identified yet */
+	handshakes[i] = -1;
+}
+
 static void socket_client_disconnected(int i) {
 	if(handshakes[i] == RECEIVER || handshakes[i] == GUI || handshakes[i] == NODE)
 		receivers--;
@@ -1295,9 +2115,11 @@ static void socket_client_disconnected(int i) {
 
 void *receive_code(void *param) {
 	struct sched_param sched;
+	struct hardware_pulse_t pulses[HARDWARE_BATCH_SIZE];
 	int plslen = 0, rawlen = 0;
 	int rawcode[255] = {0};
-	int duration = 0;
+	int duration = 0, nrpulses = 0, i = 0;
+	unsigned long long timestamp = 0;
 
 	/* Make sure the pilight receiving gets
 	   the highest priority available */
@@ -1305,14 +2127,19 @@ void *receive_code(void *param) {
 	sched.sched_priority = 70;
 	pthread_setschedparam(pthread_self(), SCHED_FIFO, &sched);
 
-	struct hardware_t *hw = (hardware_t *)param;
+	struct recvring_t *ring = (recvring_t *)param;
+	struct hardware_t *hw = ring->hardware;
 
-	pthread_mutex_lock(&receive_lock);
-	while(main_loop && hw->receive) {
-		if(sending == 0) {
-			pthread_mutex_lock(&receive_lock);
-			duration = hw->receive();
+	while(main_loop && (hw->receive || hw->receiveBatch)) {
+		/* Take as many pulses at once as the hardware module allows */
+		if(hw->receiveBatch) {
+			nrpulses = hw->receiveBatch(pulses, HARDWARE_BATCH_SIZE);
+		} else {
+			nrpulses = (hw->receive(&pulses[0]) > 0) ? 1 : 0;
+		}
 
+		for(i=0;i<nrpulses;i++) {
+			duration = pulses[i].duration;
 			if(duration > 0) {
 				rawcode[rawlen] = duration;
 				rawlen++;
@@ -1324,15 +2151,19 @@ void *receive_code(void *param) {
 						plslen = duration/PULSE_DIV;
 					}
 					/* Let's do a little filtering here as well */
-					if(rawlen >= minrawlen && rawlen <= maxrawlen) {
-						receive_queue(rawcode, rawlen, plslen, hw->type);
+					if(rawlen >= minrawlen && rawlen <= maxrawlen &&
+					   (receive_filter == 0 || receive_prefilter(ring, rawcode, rawlen, plslen, duration) == 0)) {
+						timestamp = (pulses[i].timestamp > 0) ? pulses[i].timestamp : hardware_timestamp();
+						/* Keep receiving while sending, but skip what
+						   we hear of our own transmitter */
+						if(receive_echo(ring, rawcode, rawlen, timestamp) == 0) {
+							ring->passed++;
+							receive_ring_push(ring, rawcode, rawlen, plslen, hw->type, timestamp);
+						}
 					}
 					rawlen = 0;
 				}
 			}
-			pthread_mutex_unlock(&receive_lock);
-		} else {
-			pthread_cond_wait(&receive_signal, &receive_lock);
 		}
 	}
 	return (void *)NULL;
@@ -1343,6 +2174,7 @@ void *clientize(void *param) {
 	struct ssdp_list_t *ssdp_list = NULL;
     char *recvBuff = NULL;
 	char *message = NULL;
+	char *format = NULL;
 	char *protocol = NULL;
 	int client_type = 0;
 	JsonNode *json = NULL;
@@ -1390,11 +2222,15 @@ void *clientize(void *param) {
 			}
 			switch(steps) {
 				case WELCOME:
-					socket_write(sockfd, "{\"message\":\"client node\",\"uuid\":\"%s\"}", pilight_uuid);
+					socket_write(sockfd, "{\"message\":\"client node\",\"uuid\":\"%s\",\"format\":\"binary\"}", pilight_uuid);
 					steps=IDENTIFY;
 				break;
 				case IDENTIFY:
 					if(strcmp(message, "accept client") == 0) {
+						/* Masters that know the binary format switch to it */
+						if(json_find_string(json, "format", &format) == 0 && strcmp(format, "binary") == 0) {
+							socket_set_binary(sockfd);
+						}
 						steps=FORWARD;
 					}
 					if(strcmp(message, "reject client") == 0) {
@@ -1412,6 +2248,7 @@ void *clientize(void *param) {
 				case CONFIG:
 					if((jreturn = json_find_member(json, "config"))) {
 						config_parse(jreturn);
+						sendcache_clear();
 						json_delete(jreturn);
 						steps=FORWARD;
 					}
@@ -1470,7 +2307,13 @@ void *clientize(void *param) {
 		}
 
 		if(main_loop == 1) {
+			/* The next connection starts out as json again */
+			if(sockfd > 0) {
+				socket_close(sockfd);
+				sockfd = 0;
+			}
 			config_gc();
+			sendcache_clear();
 			logprintf(LOG_NOTICE, "connection to main pilight daemon lost");
 			logprintf(LOG_NOTICE, "trying to reconnect...");
 			sleep(1);
@@ -1521,7 +2364,6 @@ static void daemonize(void) {
 int main_gc(void) {
 
 	main_loop = 0;
-	sending = 0;
 
 	/* If we are running in node mode, the clientize
 	   thread is waiting for a response from the main
@@ -1542,15 +2384,16 @@ int main_gc(void) {
 		tmp_confhw = tmp_confhw->next;
 	}
 
+	int i = 0;
+	for(i=0;i<receive_workers;i++) {
+		sem_post(&recvqueue_sem);
+	}
 	pthread_mutex_unlock(&recvqueue_lock);
-	pthread_cond_signal(&recvqueue_signal);
+	pthread_cond_broadcast(&recvqueue_signal);
 	usleep(1000);
 
 	pthread_mutex_unlock(&sendqueue_lock);
-	pthread_cond_signal(&sendqueue_signal);
-
-	pthread_mutex_unlock(&receive_lock);
-	pthread_cond_signal(&receive_signal);
+	pthread_cond_broadcast(&sendqueue_signal);
 
 	pthread_mutex_unlock(&bcqueue_lock);
 	pthread_cond_signal(&bcqueue_signal);
@@ -1611,6 +2454,11 @@ int main_gc(void) {
 	whitelist_free();
 	threads_gc();
 	pthread_join(pth, NULL);
+	receive_ring_gc();
+	sem_destroy(&recvqueue_sem);
+	sendqueue_gc();
+	sendcache_clear();
+	queue_gc();
 	log_gc();
 
 	sfree((void *)&nodes);
@@ -1928,6 +2776,9 @@ int main(int argc, char **argv) {
 	}
 
 	settings_find_number("receive-repeats", &receive_repeat);
+	settings_find_number("receive-workers", &receive_workers);
+	settings_find_number("receive-filter", &receive_filter);
+	settings_find_number("receive-min-pulse", &receive_min_pulse);
 
 	if(running == 1) {
 		nodaemon=1;
@@ -1942,8 +2793,17 @@ int main(int argc, char **argv) {
 	/* Initialize protocols */
 	protocol_init();
 
+	int minplslen = 0;
+	struct protocol_plslen_t *tmp_plslen = NULL;
 	struct protocols_t *tmp = protocols;
 	while(tmp) {
+		tmp_plslen = tmp->listener->plslen;
+		while(tmp_plslen) {
+			if(minplslen == 0 || tmp_plslen->length < minplslen) {
+				minplslen = tmp_plslen->length;
+			}
+			tmp_plslen = tmp_plslen->next;
+		}
 		if(tmp->listener->rawlen < minrawlen && tmp->listener->rawlen > 0) {
 			minrawlen = tmp->listener->rawlen;
 		}
@@ -1958,6 +2818,9 @@ int main(int argc, char **argv) {
 		}
 		tmp = tmp->next;
 	}
+	if(receive_min_pulse == 0) {
+		receive_min_pulse = minplslen/2;
+	}
 
 	if(settings_find_string("hardware-file", &hwfile) == 0) {
 		hardware_set_file(hwfile);
@@ -2007,7 +2870,17 @@ int main(int argc, char **argv) {
 			}
 		}
 
+		/* No client has identified itself yet */
+		memset(handshakes, -1, sizeof(handshakes));
 		socket_start((unsigned short)port);
+
+		/* Local tools can reach us without a tcp connection */
+		char socketfile[] = SOCKET_FILE;
+		char *socket_file = socketfile;
+		settings_find_string("socket-file", &socket_file);
+		if(strlen(socket_file) > 0) {
+			socket_start_local(socket_file);
+		}
 		if(standalone == 0) {
 			ssdp_start();
 		}
@@ -2021,10 +2894,21 @@ int main(int argc, char **argv) {
 	pthread_mutexattr_init(&sendqueue_attr);
 	pthread_mutexattr_settype(&sendqueue_attr, PTHREAD_MUTEX_RECURSIVE);
 	pthread_mutex_init(&sendqueue_lock, &sendqueue_attr);
+	sendqueue_nodes = queue_create("sender", SEND_QUEUE_SIZE, sizeof(struct sendqueue_t));
+
+	pthread_mutexattr_init(&sendcache_attr);
+	pthread_mutexattr_settype(&sendcache_attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&sendcache_lock, &sendcache_attr);
+
+	pthread_mutexattr_init(&recvring_internal_attr);
+	pthread_mutexattr_settype(&recvring_internal_attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&recvring_internal_lock, &recvring_internal_attr);
+	sem_init(&recvqueue_sem, 0, 0);
 
 	pthread_mutexattr_init(&recvqueue_attr);
 	pthread_mutexattr_settype(&recvqueue_attr, PTHREAD_MUTEX_RECURSIVE);
 	pthread_mutex_init(&recvqueue_lock, &recvqueue_attr);
+	recvring_internal = receive_ring_create("internal", NULL);
 
 	pthread_mutexattr_init(&receive_attr);
 	pthread_mutexattr_settype(&receive_attr, PTHREAD_MUTEX_RECURSIVE);
@@ -2033,19 +2917,21 @@ int main(int argc, char **argv) {
 	pthread_mutexattr_init(&bcqueue_attr);
 	pthread_mutexattr_settype(&bcqueue_attr, PTHREAD_MUTEX_RECURSIVE);
 	pthread_mutex_init(&bcqueue_lock, &bcqueue_attr);
+	bcqueue_nodes = queue_create("broadcaster", BROADCAST_QUEUE_SIZE, sizeof(struct bcqueue_t));
 
     //initialise all handshakes to -1 so not checked
 	memset(handshakes, -1, sizeof(handshakes));
 
 	/* Export certain daemon function to global usage */
 	pilight.broadcast = &broadcast_queue;
-	pilight.send = &send_queue;
+	pilight.send = &send_queue_normal;
 	pilight.receive = &receive_queue;
 
 	/* Run certain daemon functions from the socket library */
     socket_callback.client_disconnected_callback = &socket_client_disconnected;
-    socket_callback.client_connected_callback = NULL;
+    socket_callback.client_connected_callback = &socket_client_connected;
     socket_callback.client_data_callback = &socket_parse_data;
+    socket_callback.client_json_callback = &socket_parse_json;
 
 	/* Start threads library that keeps track of all threads used */
 	threads_create(&pth, NULL, &threads_start, (void *)NULL);
@@ -2061,7 +2947,14 @@ int main(int argc, char **argv) {
 			threads_register("ssdp", &ssdp_wait, (void *)NULL, 0);
 		}
 	}
-	threads_register("sender", &send_code, (void *)NULL, 0);
+	threads_register("sender", &send_code, (void *)send_worker_create(NULL), 0);
+	struct conf_hardware_t *tmp_confhw = conf_hardware;
+	while(tmp_confhw) {
+		if(tmp_confhw->hardware->send) {
+			threads_register("sender", &send_code, (void *)send_worker_create(tmp_confhw->hardware), 0);
+		}
+		tmp_confhw = tmp_confhw->next;
+	}
 	threads_register("broadcaster", &broadcast, (void *)NULL, 0);
 
 #ifdef UPDATE
@@ -2070,19 +2963,22 @@ int main(int argc, char **argv) {
 	}
 #endif
 
-	struct conf_hardware_t *tmp_confhw = conf_hardware;
+	tmp_confhw = conf_hardware;
 	while(tmp_confhw) {
 		if(tmp_confhw->hardware->init) {
 			if(tmp_confhw->hardware->init() == EXIT_FAILURE) {
 				logprintf(LOG_ERR, "could not initialize %s hardware mode", tmp_confhw->hardware->id);
 				goto clear;
 			}
-			threads_register(tmp_confhw->hardware->id, &receive_code, (void *)tmp_confhw->hardware, 0);
+			threads_register(tmp_confhw->hardware->id, &receive_code, (void *)receive_ring_create(tmp_confhw->hardware->id, tmp_confhw->hardware), 0);
 		}
 		tmp_confhw = tmp_confhw->next;
 	}
 
-	threads_register("receive parser", &receive_parse_code, (void *)NULL, 0);
+	int x = 0;
+	for(x=0;x<receive_workers;x++) {
+		threads_register("receive parser", &receive_parse_code, (void *)NULL, 0);
+	}
 
 #ifdef WEBSERVER
 	/* Register a seperate thread for the webserver */
@@ -2172,8 +3068,11 @@ int main(int argc, char **argv) {
 				json_append_member(procProtocol->message, "values", code);
 				json_append_member(procProtocol->message, "origin", json_mkstring("config"));
 				json_append_member(procProtocol->message, "type", json_mknumber(PROC));
+				send_queue_report(code);
+				receive_filter_report(code);
 				pilight.broadcast(procProtocol->id, procProtocol->message);
 				procProtocol->message = NULL;
+				receive_ring_report();
 				i = 0;
 			}
 			i++;
@@ -81,6 +81,7 @@ int main_gc(void) {
 }
 
 void *receive_code(void *param) {
+	struct hardware_pulse_t hwpulse;
 	int duration = 0;
 	int i = 0;
 	int y = 0;
@@ -122,7 +123,7 @@ void *receive_code(void *param) {
 		time(&now);
 
 		while(inner_loop && hw->receive) {
-			duration = hw->receive();
+			duration = hw->receive(&hwpulse);
 			time(&later);
 			if(difftime(later, now) > 1) {
 				inner_loop = 0;
@@ -119,6 +119,7 @@ int main_gc(void) {
 }
 
 void *receive_code(void *param) {
+	struct hardware_pulse_t hwpulse;
 	int duration = 0;
 	int i = 0;
 	int y = 0;
@@ -273,7 +274,7 @@ void *receive_code(void *param) {
 		else
 			state=WAIT;
 
-		duration = hw->receive();
+		duration = hw->receive(&hwpulse);
 
 		/* If we are recording, keep recording until the next footer has been matched */
 		if(recording == 1) {
@@ -20,6 +20,15 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#ifdef __linux__
+	#include <linux/gpio.h>
+#endif
 
 #include "../../pilight.h"
 #include "common.h"
@@ -29,21 +38,112 @@
 #include "wiringPi.h"
 #include "json.h"
 #include "irq.h"
+#include "gc.h"
 #include "433gpio.h"
 
 static int gpio_433_in = 0;
 static int gpio_433_out = 0;
 static int gpio_433_initialized = 0;
+/* When a GPIO character device is configured, the receiver
+   is the offset of the line on that chip */
+static char *gpio_433_chip = NULL;
+static int gpio_433_line_fd = -1;
+static unsigned long long gpio_433_last = 0;
+
+#ifdef GPIO_V2_GET_LINE_IOCTL
+/* Request edge events of the receiver line. The kernel timestamps
+   every edge in the interrupt handler and queues the events. */
+static int gpio433ChipOpen(void) {
+	struct gpio_v2_line_request req;
+	int fd = 0;
+
+	if((fd = open(gpio_433_chip, O_RDONLY)) < 0) {
+		logprintf(LOG_ERR, "could not open %s", gpio_433_chip);
+		return -1;
+	}
+
+	memset(&req, 0, sizeof(req));
+	req.offsets[0] = (__u32)gpio_433_in;
+	req.num_lines = 1;
+	req.event_buffer_size = HARDWARE_BATCH_SIZE;
+	req.config.flags = GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING;
+	strncpy(req.consumer, "pilight", sizeof(req.consumer)-1);
+
+	if(ioctl(fd, GPIO_V2_GET_LINE_IOCTL, &req) < 0) {
+		logprintf(LOG_ERR, "unable to request edge events for line %d of %s", gpio_433_in, gpio_433_chip);
+		close(fd);
+		return -1;
+	}
+	/* The line stays requested through its own file descriptor */
+	close(fd);
+
+	gpio_433_line_fd = req.fd;
+	gpio_433_last = 0;
+	return 0;
+}
+
+/* The event timestamps are on the CLOCK_MONOTONIC,
+   the pulses are stamped on the raw monotonic clock */
+static int gpio433ChipRead(struct hardware_pulse_t *pulses, int max) {
+	struct gpio_v2_line_event events[HARDWARE_BATCH_SIZE];
+	struct pollfd pfd;
+	struct timespec ts;
+	unsigned long long length = 0, offset = 0;
+	ssize_t n = 0;
+	int i = 0, nr = 0;
+
+	pfd.fd = gpio_433_line_fd;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	if(poll(&pfd, 1, 1000) <= 0) {
+		return 0;
+	}
+
+	if(max > HARDWARE_BATCH_SIZE) {
+		max = HARDWARE_BATCH_SIZE;
+	}
+	if((n = read(gpio_433_line_fd, events, sizeof(struct gpio_v2_line_event)*(size_t)max)) <= 0) {
+		return 0;
+	}
+	n /= (ssize_t)sizeof(struct gpio_v2_line_event);
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	offset = hardware_timestamp() - ((unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec);
+
+	for(i=0;i<(int)n;i++) {
+		if(gpio_433_last > 0 && events[i].timestamp_ns > gpio_433_last) {
+			length = (events[i].timestamp_ns - gpio_433_last) / 1000;
+			pulses[nr].duration = (length > INT_MAX) ? INT_MAX : (int)length;
+			pulses[nr].timestamp = events[i].timestamp_ns + offset;
+			nr++;
+		}
+		gpio_433_last = events[i].timestamp_ns;
+	}
+	return nr;
+}
+#endif
 
 static unsigned short gpio433HwInit(void) {
-	if(wiringPiSetup() == -1) {
+	if(gpio_433_chip && gpio_433_in >= 0) {
+#ifdef GPIO_V2_GET_LINE_IOCTL
+		if(gpio433ChipOpen() == -1) {
+			return EXIT_FAILURE;
+		}
+#else
+		logprintf(LOG_ERR, "gpio character devices are not supported on this system");
 		return EXIT_FAILURE;
+#endif
+	}
+	if(gpio_433_out >= 0 || (gpio_433_in >= 0 && gpio_433_line_fd == -1)) {
+		if(wiringPiSetup() == -1) {
+			return EXIT_FAILURE;
+		}
+		gpio_433_initialized = 1;
 	}
-	gpio_433_initialized = 1;
 	if(gpio_433_out >= 0) {
 		pinMode(gpio_433_out, OUTPUT);
 	}
-	if(gpio_433_in >= 0) {
+	if(gpio_433_in >= 0 && gpio_433_line_fd == -1) {
 		if(wiringPiISR(gpio_433_in, INT_EDGE_BOTH) < 0) {
 			logprintf(LOG_ERR, "unable to register interrupt for pin %d", gpio_433_in) ;
 			return EXIT_SUCCESS;
@@ -54,12 +154,16 @@ static unsigned short gpio433HwInit(void) {
 
 static unsigned short gpio433HwDeinit(void) {
 	FILE *fd;
+	if(gpio_433_line_fd > -1) {
+		close(gpio_433_line_fd);
+		gpio_433_line_fd = -1;
+	}
 	if(gpio_433_initialized) {
 		if(gpio_433_out >= 0 && (fd = fopen ("/sys/class/gpio/unexport", "w"))) {
 			fprintf(fd, "%d", wpiPinToGpio(gpio_433_out));
 			fclose(fd);
 		}
-		if(gpio_433_in >= 0 && (fd = fopen ("/sys/class/gpio/unexport", "w"))) {
+		if(gpio_433_in >= 0 && !gpio_433_chip && (fd = fopen ("/sys/class/gpio/unexport", "w"))) {
 			fprintf(fd, "%d", wpiPinToGpio(gpio_433_in));
 			fclose(fd);
 		}
@@ -67,14 +171,80 @@ static unsigned short gpio433HwDeinit(void) {
 	return EXIT_SUCCESS;
 }
 
+/* The last part of every pulse is spinned instead of slept,
+   so a wakeup latency of the scheduler does not lengthen it */
+#define GPIO_433_SPIN		80000
+
+static long long gpio433Elapsed(struct timespec *deadline) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (long long)(now.tv_sec - deadline->tv_sec) * 1000000000LL + (now.tv_nsec - deadline->tv_nsec);
+}
+
+/* Wait until an absolute deadline and return how late we are in ns */
+static long long gpio433Wait(struct timespec *deadline) {
+	struct timespec wakeup;
+	long long late = 0;
+
+	wakeup.tv_sec = deadline->tv_sec;
+	if(deadline->tv_nsec >= GPIO_433_SPIN) {
+		wakeup.tv_nsec = deadline->tv_nsec - GPIO_433_SPIN;
+	} else {
+		wakeup.tv_sec--;
+		wakeup.tv_nsec = deadline->tv_nsec + (1000000000 - GPIO_433_SPIN);
+	}
+	while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wakeup, NULL) == EINTR);
+	while((late = gpio433Elapsed(deadline)) < 0);
+
+	return late;
+}
+
+static void gpio433Deadline(struct timespec *deadline, int usec) {
+	deadline->tv_nsec += (long)usec * 1000;
+	while(deadline->tv_nsec >= 1000000000) {
+		deadline->tv_sec++;
+		deadline->tv_nsec -= 1000000000;
+	}
+}
+
+/* Every edge is scheduled against the start of the code instead of
+   the previous edge, so errors do not add up over the whole code */
 static int gpio433Send(int *code) {
+	struct timespec deadline;
+	long long late = 0, total = 0, worst = 0;
 	unsigned short i = 0;
+	int edges = 0, shortest = INT_MAX;
+
 	if(gpio_433_out >= 0) {
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
 		while(code[i]) {
 			digitalWrite(gpio_433_out, 1);
-			usleep((__useconds_t)code[i++]);
+			gpio433Deadline(&deadline, code[i]);
+			if(code[i] < shortest) {
+				shortest = code[i];
+			}
+			i++;
+			late = gpio433Wait(&deadline);
 			digitalWrite(gpio_433_out, 0);
-			usleep((__useconds_t)code[i++]);
+			total += late;
+			worst = (late > worst) ? late : worst;
+			edges++;
+
+			gpio433Deadline(&deadline, code[i]);
+			if(code[i] > 0 && code[i] < shortest) {
+				shortest = code[i];
+			}
+			i++;
+			late = gpio433Wait(&deadline);
+			total += late;
+			worst = (late > worst) ? late : worst;
+			edges++;
+		}
+		if(edges > 0) {
+			logprintf(LOG_DEBUG, "433gpio sent %d edges, average error %lld ns, worst error %lld ns", edges, total/edges, worst);
+			if(worst/1000 > shortest/4) {
+				logprintf(LOG_NOTICE, "433gpio edge was %lld usec late on a pulse of %d usec", worst/1000, shortest);
+			}
 		}
 	} else {
 		sleep(1);
@@ -82,15 +252,36 @@ static int gpio433Send(int *code) {
 	return EXIT_SUCCESS;
 }
 
-static int gpio433Receive(void) {
+static int gpio433Receive(struct hardware_pulse_t *pulse) {
+#ifdef GPIO_V2_GET_LINE_IOCTL
+	if(gpio_433_line_fd > -1) {
+		if(gpio433ChipRead(pulse, 1) == 1) {
+			return pulse->duration;
+		}
+		pulse->timestamp = 0;
+		pulse->duration = 0;
+		return 0;
+	}
+#endif
 	if(gpio_433_in >= 0) {
-		return irq_read(gpio_433_in);
+		return irq_read(gpio_433_in, pulse);
 	} else {
 		sleep(1);
+		pulse->timestamp = 0;
+		pulse->duration = 0;
 		return 0;
 	}
 }
 
+static int gpio433ReceiveBatch(struct hardware_pulse_t *pulses, int max) {
+#ifdef GPIO_V2_GET_LINE_IOCTL
+	if(gpio_433_line_fd > -1) {
+		return gpio433ChipRead(pulses, max);
+	}
+#endif
+	return (gpio433Receive(&pulses[0]) > 0) ? 1 : 0;
+}
+
 static unsigned short gpio433Settings(JsonNode *json) {
 	if(strcmp(json->key, "receiver") == 0) {
 		if(json->tag == JSON_NUMBER) {
@@ -106,24 +297,47 @@ static unsigned short gpio433Settings(JsonNode *json) {
 			return EXIT_FAILURE;
 		}
 	}
+	if(strcmp(json->key, "chip") == 0) {
+		if(json->tag == JSON_STRING) {
+			if(!(gpio_433_chip = realloc(gpio_433_chip, strlen(json->string_)+1))) {
+				logprintf(LOG_ERR, "out of memory");
+				exit(EXIT_FAILURE);
+			}
+			strcpy(gpio_433_chip, json->string_);
+		} else {
+			return EXIT_FAILURE;
+		}
+	}
 	return EXIT_SUCCESS;
 }
 
+static int gpio433gc(void) {
+	if(gpio_433_chip) {
+		sfree((void *)&gpio_433_chip);
+	}
+	return 1;
+}
+
 #ifndef MODULE
 __attribute__((weak))
 #endif
 void gpio433Init(void) {
+
+	gc_attach(gpio433gc);
+
 	hardware_register(&gpio433);
 	hardware_set_id(gpio433, "433gpio");
 
 	options_add(&gpio433->options, 'r', "receiver", OPTION_HAS_VALUE, CONFIG_VALUE, JSON_NUMBER, NULL, "^[0-9-]+$");
 	options_add(&gpio433->options, 's', "sender", OPTION_HAS_VALUE, CONFIG_VALUE, JSON_NUMBER, NULL, "^[0-9-]+$");
+	options_add(&gpio433->options, 'c', "chip", OPTION_OPT_VALUE, CONFIG_VALUE, JSON_STRING, NULL, "^/dev/gpiochip[0-9]+$");
 
 	gpio433->type=RF433;
 	gpio433->init=&gpio433HwInit;
 	gpio433->deinit=&gpio433HwDeinit;
 	gpio433->send=&gpio433Send;
 	gpio433->receive=&gpio433Receive;
+	gpio433->receiveBatch=&gpio433ReceiveBatch;
 	gpio433->settings=&gpio433Settings;
 }
 
@@ -20,6 +20,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
 #include <fcntl.h>
 #include <unistd.h>
 
@@ -34,6 +35,7 @@
 
 #define FREQ433				433920
 #define FREQ38				38000
+#define LIRC_433_IOV		64
 
 static int lirc_433_initialized = 0;
 static int lirc_433_setfreq = 0;
@@ -115,14 +117,73 @@ static int lirc433Send(int *code) {
 	}
 }
 
-static int lirc433Receive(void) {
+/* Write the repeats straight from the single code, every
+   write ends with a zero just like the ones of lirc433Send */
+static int lirc433SendRepeat(int *code, int rawlen, int repeats) {
+	struct iovec iov[LIRC_433_IOV];
+	int zero = 0, i = 0, n = 0;
+	ssize_t len = 0;
+
+	while(repeats > 0) {
+		n = (repeats < LIRC_433_IOV-1) ? repeats : LIRC_433_IOV-1;
+		len = 0;
+		for(i=0;i<n;i++) {
+			iov[i].iov_base = code;
+			iov[i].iov_len = sizeof(int)*(size_t)rawlen;
+			len += (ssize_t)iov[i].iov_len;
+		}
+		iov[n].iov_base = &zero;
+		iov[n].iov_len = sizeof(int);
+		len += (ssize_t)sizeof(int);
+
+		if(writev(lirc_433_fd, iov, n+1) != len) {
+			return EXIT_FAILURE;
+		}
+		repeats -= n;
+	}
+	return EXIT_SUCCESS;
+}
+
+static int lirc433Receive(struct hardware_pulse_t *pulse) {
 	int data = 0;
 
 	if((read(lirc_433_fd, &data, sizeof(data))) == 0) {
 		data = 1;
 	}
 
-	return (data & 0x00FFFFFF);
+	pulse->timestamp = hardware_timestamp();
+	pulse->duration = (data & 0x00FFFFFF);
+	return pulse->duration;
+}
+
+/* The lirc device hands out all samples it has buffered in a
+   single read. Only the read itself can be timestamped, so the
+   earlier pulses are stamped by going back their lengths. */
+static int lirc433ReceiveBatch(struct hardware_pulse_t *pulses, int max) {
+	int data[HARDWARE_BATCH_SIZE];
+	unsigned long long timestamp = 0;
+	ssize_t n = 0;
+	size_t i = 0;
+
+	if(max > HARDWARE_BATCH_SIZE) {
+		max = HARDWARE_BATCH_SIZE;
+	}
+	if((n = read(lirc_433_fd, data, sizeof(int)*(size_t)max)) < 0) {
+		return -1;
+	} else if(n == 0) {
+		pulses[0].timestamp = hardware_timestamp();
+		pulses[0].duration = 1;
+		return 1;
+	}
+
+	timestamp = hardware_timestamp();
+	n /= (ssize_t)sizeof(int);
+	for(i=(size_t)n;i>0;i--) {
+		pulses[i-1].duration = (data[i-1] & 0x00FFFFFF);
+		pulses[i-1].timestamp = timestamp;
+		timestamp -= (unsigned long long)pulses[i-1].duration * 1000;
+	}
+	return (int)n;
 }
 
 static unsigned short lirc433Settings(JsonNode *json) {
@@ -166,7 +227,9 @@ void lirc433Init(void) {
 	lirc433->init=&lirc433HwInit;
 	lirc433->deinit=&lirc433HwDeinit;
 	lirc433->send=&lirc433Send;
+	lirc433->sendRepeat=&lirc433SendRepeat;
 	lirc433->receive=&lirc433Receive;
+	lirc433->receiveBatch=&lirc433ReceiveBatch;
 	lirc433->settings=&lirc433Settings;
 }
 
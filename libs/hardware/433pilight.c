@@ -20,6 +20,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
 #include <fcntl.h>
 #include <unistd.h>
 
@@ -43,6 +44,8 @@
 #define IOCTL_START_TRANSMITTER		17
 #define IOCTL_STOP_TRANSMITTER		18
 
+#define PILIGHT_433_IOV				64
+
 static int pilight_433_rec_initialized = 0;
 static int pilight_433_trans_initialized = 0;
 static int pilight_433_fd_rec = 0;
@@ -53,6 +56,9 @@ static int pilight_433_prefilter = 0;
 static int pilight_433_svp = 0;
 static int pilight_433_lvp = 0;
 static char *pilight_433_socket = NULL;
+/* Unparsed tail of the last batch read */
+static char pilight_433_buff[4096];
+static size_t pilight_433_buflen = 0;
 
 static unsigned short pilight433HwInit(void) {
 	int filter_on = 1;
@@ -112,6 +118,7 @@ static unsigned short pilight433HwDeinit(void) {
 			close(pilight_433_fd_rec);
 			pilight_433_fd_rec = 0;
 		}
+		pilight_433_buflen = 0;
 		logprintf(LOG_DEBUG, "deinitialized pilight receiver module");
 		pilight_433_rec_initialized	= 0;
 	}
@@ -148,13 +155,88 @@ static int pilight433Send(int *code) {
 	return EXIT_FAILURE;
 }
 
-static int pilight433Receive(void) {
+/* Write the repeats straight from the single code, every
+   write ends with a zero just like the ones of pilight433Send */
+static int pilight433SendRepeat(int *code, int rawlen, int repeats) {
+	struct iovec iov[PILIGHT_433_IOV];
+	int zero = 0, i = 0, n = 0;
+	ssize_t len = 0;
+
+	while(repeats > 0) {
+		n = (repeats < PILIGHT_433_IOV-1) ? repeats : PILIGHT_433_IOV-1;
+		len = 0;
+		for(i=0;i<n;i++) {
+			iov[i].iov_base = code;
+			iov[i].iov_len = sizeof(int)*(size_t)rawlen;
+			len += (ssize_t)iov[i].iov_len;
+		}
+		iov[n].iov_base = &zero;
+		iov[n].iov_len = sizeof(int);
+		len += (ssize_t)sizeof(int);
+
+		if(writev(pilight_433_fd_trans, iov, n+1) != len) {
+			return EXIT_FAILURE;
+		}
+		repeats -= n;
+	}
+	return EXIT_SUCCESS;
+}
+
+static int pilight433Receive(struct hardware_pulse_t *pulse) {
 	char buff[255] = {0};
+
+	pulse->timestamp = 0;
+	pulse->duration = 0;
 	if((read(pilight_433_fd_rec, buff, sizeof(buff))) < 0) {
 		usleep(5000*1000);
 		return 0;
 	}
-	return (atoi(buff));
+	pulse->timestamp = hardware_timestamp();
+	pulse->duration = atoi(buff);
+	return pulse->duration;
+}
+
+/* Parse all pulse lengths the kernel module has buffered. A read
+   can end in the middle of a number, so whatever follows the last
+   complete number is kept and parsed together with the next read. */
+static int pilight433ReceiveBatch(struct hardware_pulse_t *pulses, int max) {
+	char *p = pilight_433_buff, *end = NULL;
+	unsigned long long timestamp = 0;
+	ssize_t n = 0;
+	size_t len = 0;
+	int nr = 0, i = 0;
+	long l = 0;
+
+	if((n = read(pilight_433_fd_rec, &pilight_433_buff[pilight_433_buflen],
+				 sizeof(pilight_433_buff)-1-pilight_433_buflen)) < 0) {
+		usleep(5000*1000);
+		return 0;
+	}
+	len = pilight_433_buflen+(size_t)n;
+	pilight_433_buff[len] = '\0';
+	timestamp = hardware_timestamp();
+
+	while(nr < max) {
+		l = strtol(p, &end, 10);
+		if(end == p || end == &pilight_433_buff[len]) {
+			break;
+		}
+		pulses[nr++].duration = (int)l;
+		p = end;
+	}
+
+	pilight_433_buflen = len-(size_t)(p-pilight_433_buff);
+	if(pilight_433_buflen == sizeof(pilight_433_buff)-1 && nr == 0) {
+		/* Nothing but an endless number, drop it */
+		pilight_433_buflen = 0;
+	}
+	memmove(pilight_433_buff, p, pilight_433_buflen);
+
+	for(i=nr;i>0;i--) {
+		pulses[i-1].timestamp = timestamp;
+		timestamp -= (unsigned long long)pulses[i-1].duration * 1000;
+	}
+	return nr;
 }
 
 static unsigned short pilight433Settings(JsonNode *json) {
@@ -238,7 +320,9 @@ void pilight433Init(void) {
 	pilight433->init=&pilight433HwInit;
 	pilight433->deinit=&pilight433HwDeinit;
 	pilight433->send=&pilight433Send;
+	pilight433->sendRepeat=&pilight433SendRepeat;
 	pilight433->receive=&pilight433Receive;
+	pilight433->receiveBatch=&pilight433ReceiveBatch;
 	pilight433->settings=&pilight433Settings;
 }
 
@@ -0,0 +1,264 @@
+/*
+	Copyright (C) 2013 - 2014 CurlyMo
+
+	This file is part of pilight.
+
+    pilight is free software: you can redistribute it and/or modify it under the
+	terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later
+	version.
+
+    pilight is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+	A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with pilight. If not, see	<http://www.gnu.org/licenses/>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+
+#include "../../pilight.h"
+#include "common.h"
+#include "dso.h"
+#include "log.h"
+#include "hardware.h"
+#include "json.h"
+#include "gc.h"
+#include "433replay.h"
+
+typedef struct replay_pulse_t {
+	unsigned long long timestamp;
+	int duration;
+} replay_pulse_t;
+
+static struct replay_pulse_t *replay_433_pulses = NULL;
+static int replay_433_nrpulses = 0;
+static int replay_433_pos = 0;
+static int replay_433_speed = 1;
+static int replay_433_loop = 0;
+static char *replay_433_file = NULL;
+static struct timespec replay_433_start;
+
+/*
+ * A capture file contains one pulse per line, either as
+ * "<timestamp> <duration>" in microseconds, or as the
+ * "<hardware>: <duration>" output of pilight-raw. When no
+ * timestamp is given, the end of the previous pulse is used.
+ * Timestamps may not decrease from one line to the next.
+ * Empty lines and lines starting with a # are ignored.
+ */
+static int replay433ParseLine(char *line, unsigned long long *timestamp, int *duration) {
+	char *p = line, *end = NULL;
+	unsigned long long a = 0, b = 0;
+
+	while(isspace((unsigned char)*p)) {
+		p++;
+	}
+	if(*p == '\0' || *p == '#') {
+		return 0;
+	}
+	if((end = strchr(p, ':'))) {
+		p = end+1;
+	}
+
+	errno = 0;
+	a = strtoull(p, &end, 10);
+	if(end == p || errno != 0) {
+		return -1;
+	}
+	p = end;
+	b = strtoull(p, &end, 10);
+	if(end == p) {
+		*duration = (int)a;
+		return 1;
+	}
+	if(errno != 0 || b > 0x7FFFFFFF) {
+		return -1;
+	}
+	*timestamp = a;
+	*duration = (int)b;
+	return 2;
+}
+
+static unsigned short replay433HwInit(void) {
+	FILE *fp = NULL;
+	char line[255];
+	unsigned long long timestamp = 0;
+	int duration = 0, size = 0, nr = 0, ret = 0;
+
+	if(!(fp = fopen(replay_433_file, "r"))) {
+		logprintf(LOG_ERR, "could not open replay file %s", replay_433_file);
+		return EXIT_FAILURE;
+	}
+
+	replay_433_nrpulses = 0;
+	while(fgets(line, sizeof(line), fp)) {
+		nr++;
+		if((ret = replay433ParseLine(line, &timestamp, &duration)) == 0) {
+			continue;
+		} else if(ret < 0 || duration <= 0) {
+			logprintf(LOG_ERR, "replay file %s, invalid pulse on line %d", replay_433_file, nr);
+			fclose(fp);
+			return EXIT_FAILURE;
+		} else if(ret == 1) {
+			timestamp = 0;
+			if(replay_433_nrpulses > 0) {
+				timestamp = replay_433_pulses[replay_433_nrpulses-1].timestamp;
+			}
+			timestamp += (unsigned long long)duration;
+		} else if(replay_433_nrpulses > 0 && timestamp < replay_433_pulses[replay_433_nrpulses-1].timestamp) {
+			logprintf(LOG_ERR, "replay file %s, timestamp goes back in time on line %d", replay_433_file, nr);
+			fclose(fp);
+			return EXIT_FAILURE;
+		}
+		if(replay_433_nrpulses == size) {
+			size = (size == 0) ? 1024 : size*2;
+			if(!(replay_433_pulses = realloc(replay_433_pulses, sizeof(struct replay_pulse_t)*(size_t)size))) {
+				logprintf(LOG_ERR, "out of memory");
+				exit(EXIT_FAILURE);
+			}
+		}
+		replay_433_pulses[replay_433_nrpulses].timestamp = timestamp;
+		replay_433_pulses[replay_433_nrpulses].duration = duration;
+		replay_433_nrpulses++;
+	}
+	fclose(fp);
+
+	if(replay_433_nrpulses == 0) {
+		logprintf(LOG_ERR, "replay file %s does not contain any pulses", replay_433_file);
+		return EXIT_FAILURE;
+	}
+
+	logprintf(LOG_DEBUG, "loaded %d pulses from %s", replay_433_nrpulses, replay_433_file);
+
+	replay_433_pos = 0;
+	clock_gettime(CLOCK_MONOTONIC, &replay_433_start);
+
+	return EXIT_SUCCESS;
+}
+
+static unsigned short replay433HwDeinit(void) {
+	sfree((void *)&replay_433_pulses);
+	replay_433_nrpulses = 0;
+	replay_433_pos = 0;
+	return EXIT_SUCCESS;
+}
+
+static int replay433Send(int *code) {
+	return EXIT_SUCCESS;
+}
+
+static int replay433Receive(struct hardware_pulse_t *pulse) {
+	struct replay_pulse_t *node = NULL;
+	struct timespec ts;
+	unsigned long long offset = 0;
+
+	pulse->timestamp = 0;
+	pulse->duration = 0;
+	if(replay_433_pos >= replay_433_nrpulses) {
+		if(replay_433_loop == 0 || replay_433_nrpulses == 0) {
+			sleep(1);
+			return 0;
+		}
+		replay_433_pos = 0;
+		clock_gettime(CLOCK_MONOTONIC, &replay_433_start);
+	}
+
+	node = &replay_433_pulses[replay_433_pos++];
+
+	/* Wait until the pulse would have ended relative
+	   to the first pulse in the capture */
+	if(replay_433_speed > 0) {
+		offset = (node->timestamp - replay_433_pulses[0].timestamp)*1000/(unsigned long long)replay_433_speed;
+		ts.tv_sec = replay_433_start.tv_sec + (time_t)(offset / 1000000000);
+		ts.tv_nsec = replay_433_start.tv_nsec + (long)(offset % 1000000000);
+		if(ts.tv_nsec >= 1000000000) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+		while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+	}
+
+	pulse->timestamp = hardware_timestamp();
+	pulse->duration = node->duration;
+	return pulse->duration;
+}
+
+static unsigned short replay433Settings(JsonNode *json) {
+	if(strcmp(json->key, "file") == 0) {
+		if(json->tag == JSON_STRING) {
+			if(!(replay_433_file = realloc(replay_433_file, strlen(json->string_)+1))) {
+				logprintf(LOG_ERR, "out of memory");
+				exit(EXIT_FAILURE);
+			}
+			strcpy(replay_433_file, json->string_);
+		} else {
+			return EXIT_FAILURE;
+		}
+	}
+	if(strcmp(json->key, "speed") == 0) {
+		if(json->tag == JSON_NUMBER) {
+			replay_433_speed = (int)json->number_;
+		} else {
+			return EXIT_FAILURE;
+		}
+	}
+	if(strcmp(json->key, "loop") == 0) {
+		if(json->tag == JSON_NUMBER) {
+			replay_433_loop = (int)json->number_;
+		} else {
+			return EXIT_FAILURE;
+		}
+	}
+	return EXIT_SUCCESS;
+}
+
+static int replay433gc(void) {
+	sfree((void *)&replay_433_pulses);
+	if(replay_433_file) {
+		sfree((void *)&replay_433_file);
+	}
+	return 1;
+}
+
+#ifndef MODULE
+__attribute__((weak))
+#endif
+void replay433Init(void) {
+
+	gc_attach(replay433gc);
+
+	hardware_register(&replay433);
+	hardware_set_id(replay433, "433replay");
+
+	options_add(&replay433->options, 'f', "file", OPTION_HAS_VALUE, CONFIG_VALUE, JSON_STRING, NULL, "^.+$");
+	options_add(&replay433->options, 's', "speed", OPTION_OPT_VALUE, CONFIG_VALUE, JSON_NUMBER, NULL, "^[0-9]+$");
+	options_add(&replay433->options, 'l', "loop", OPTION_OPT_VALUE, CONFIG_VALUE, JSON_NUMBER, NULL, "^[01]$");
+
+	replay433->type=RF433;
+	replay433->init=&replay433HwInit;
+	replay433->deinit=&replay433HwDeinit;
+	replay433->send=&replay433Send;
+	replay433->receive=&replay433Receive;
+	replay433->settings=&replay433Settings;
+}
+
+#ifdef MODULE
+void compatibility(struct module_t *module) {
+	module->name = "433replay";
+	module->version = "1.0";
+	module->reqversion = "5.0";
+	module->reqcommit = NULL;
+}
+
+void init(void) {
+	replay433Init();
+}
+#endif
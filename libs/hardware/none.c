@@ -31,8 +31,10 @@ static int noneSend(int *code) {
 	return EXIT_SUCCESS;
 }
 
-static int noneReceive(void) {
+static int noneReceive(struct hardware_pulse_t *pulse) {
 	sleep(1);
+	pulse->timestamp = 0;
+	pulse->duration = 0;
 	return EXIT_SUCCESS;
 }
 
@@ -155,3 +155,74 @@ int decToBinRevUl(unsigned long long n, int binary[]) {
 	}
 	return (int)x;
 }
+
+/* Packs code[offset], code[offset+step], ... for every position below
+   len as one bit each and returns the number of bits that were packed */
+int binPackCode(int *code, int len, int offset, int step, uint64_t *packed) {
+	uint64_t word = 0;
+	unsigned int nr = 0;
+	int i = 0;
+
+	for(i=0;i<len;i+=step) {
+		word = (word << 1) | (uint64_t)(code[i+offset] == 1);
+		nr++;
+		if((nr % BINARY_WORD_BITS) == 0) {
+			packed[(nr/BINARY_WORD_BITS)-1] = word;
+			word = 0;
+		}
+	}
+	if((nr % BINARY_WORD_BITS) > 0) {
+		packed[nr/BINARY_WORD_BITS] = word << (BINARY_WORD_BITS-(nr % BINARY_WORD_BITS));
+	}
+	return (int)nr;
+}
+
+void binPack(int *binary, int len, uint64_t *packed) {
+	binPackCode(binary, len, 0, 1, packed);
+}
+
+void binPackedSet(uint64_t *packed, int i, int bit) {
+	uint64_t mask = ((uint64_t)1 << (BINARY_WORD_BITS-1-(i%BINARY_WORD_BITS)));
+	if(bit == 1) {
+		packed[i/BINARY_WORD_BITS] |= mask;
+	} else {
+		packed[i/BINARY_WORD_BITS] &= ~mask;
+	}
+}
+
+int binPackedGet(uint64_t *packed, int i) {
+	return (int)((packed[i/BINARY_WORD_BITS] >> (BINARY_WORD_BITS-1-(i%BINARY_WORD_BITS))) & 1);
+}
+
+/* Bits s till e (max. 64 bits) with bit s as the most significant bit */
+unsigned long long binPackedToDecRev(uint64_t *packed, unsigned int s, unsigned int e) {
+	unsigned int len = e-s+1;
+	unsigned int w = s/BINARY_WORD_BITS;
+	unsigned int o = s%BINARY_WORD_BITS;
+	uint64_t dec = packed[w] << o;
+
+	/* The field continues in the next word */
+	if(o > 0 && (o+len) > BINARY_WORD_BITS) {
+		dec |= packed[w+1] >> (BINARY_WORD_BITS-o);
+	}
+	if(len < BINARY_WORD_BITS) {
+		dec >>= (BINARY_WORD_BITS-len);
+	}
+	return (unsigned long long)dec;
+}
+
+/* Bits s till e (max. 64 bits) with bit s as the least significant bit */
+unsigned long long binPackedToDec(uint64_t *packed, unsigned int s, unsigned int e) {
+	unsigned int len = e-s+1;
+	uint64_t dec = binPackedToDecRev(packed, s, e);
+
+	/* Mirror the field */
+	dec = ((dec >> 1) & 0x5555555555555555ULL) | ((dec & 0x5555555555555555ULL) << 1);
+	dec = ((dec >> 2) & 0x3333333333333333ULL) | ((dec & 0x3333333333333333ULL) << 2);
+	dec = ((dec >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((dec & 0x0F0F0F0F0F0F0F0FULL) << 4);
+	dec = ((dec >> 8) & 0x00FF00FF00FF00FFULL) | ((dec & 0x00FF00FF00FF00FFULL) << 8);
+	dec = ((dec >> 16) & 0x0000FFFF0000FFFFULL) | ((dec & 0x0000FFFF0000FFFFULL) << 16);
+	dec = (dec >> 32) | (dec << 32);
+
+	return (unsigned long long)(dec >> (BINARY_WORD_BITS-len));
+}
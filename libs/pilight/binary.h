@@ -19,6 +19,13 @@
 #ifndef _BINARY_H_
 #define _BINARY_H_
 
+#include <stdint.h>
+
+/* Packed binaries store the first bit in the most
+   significant bit of the first 64 bit word */
+#define BINARY_WORD_BITS	64
+#define BINARY_WORDS(n)		(((n)+BINARY_WORD_BITS-1)/BINARY_WORD_BITS)
+
 int binToDecRev(int *binary, int s, int e);
 int binToDec(int *binary, int s, int e);
 int decToBinRev(int nr, int *binary);
@@ -28,5 +35,11 @@ unsigned long long binToDecRevUl(int *binary, unsigned int s, unsigned int e);
 unsigned long long binToDecUl(int *binary, unsigned int s, unsigned int e);
 int decToBinUl(unsigned long long n, int binary[]);
 int decToBinRevUl(unsigned long long n, int binary[]);
+int binPackCode(int *code, int len, int offset, int step, uint64_t *packed);
+void binPack(int *binary, int len, uint64_t *packed);
+void binPackedSet(uint64_t *packed, int i, int bit);
+int binPackedGet(uint64_t *packed, int i);
+unsigned long long binPackedToDecRev(uint64_t *packed, unsigned int s, unsigned int e);
+unsigned long long binPackedToDec(uint64_t *packed, unsigned int s, unsigned int e);
 
 #endif
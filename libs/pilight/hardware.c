@@ -170,7 +170,9 @@ void hardware_register(struct hardware_t **hw) {
 	(*hw)->init = NULL;
 	(*hw)->deinit = NULL;
 	(*hw)->receive = NULL;
+	(*hw)->receiveBatch = NULL;
 	(*hw)->send = NULL;
+	(*hw)->sendRepeat = NULL;
 	(*hw)->settings = NULL;
 
 	(*hw)->next = hardware;
@@ -186,6 +188,18 @@ void hardware_set_id(hardware_t *hw, const char *id) {
 	strcpy(hw->id, id);
 }
 
+/* The raw monotonic clock is not slewed by NTP, so
+   the difference between two edges is a true length */
+unsigned long long hardware_timestamp(void) {
+	struct timespec ts;
+#ifdef CLOCK_MONOTONIC_RAW
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+#else
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
 int hardware_gc(void) {
 	struct hardware_t *htmp;
 	struct conf_hardware_t *ctmp = NULL;
@@ -280,11 +294,10 @@ int hardware_parse(JsonNode *root) {
 					have_error = 1;
 					goto clear;
 				}
-				/* And only allow one module covering the same frequency */
+				/* Several modules covering the same frequency
+				   will send and receive side by side */
 				if(tmp_confhw->hardware->type == hw->type) {
-					logprintf(LOG_ERR, "hardware module #%d \"%s\", duplicate freq.", i, jchilds->key);
-					have_error = 1;
-					goto clear;
+					logprintf(LOG_DEBUG, "hardware module #%d \"%s\", shares its freq. with \"%s\"", i, jchilds->key, tmp_confhw->hardware->id);
 				}
 				tmp_confhw = tmp_confhw->next;
 			}
@@ -296,14 +309,17 @@ int hardware_parse(JsonNode *root) {
 				jvalues = json_first_child(jchilds);
 				while(jvalues) {
 					if(jvalues->tag == JSON_NUMBER || jvalues->tag == JSON_STRING) {
-						if(strcmp(jvalues->key, hw_options->name) == 0 && hw_options->argtype == OPTION_HAS_VALUE) {
+						if(strcmp(jvalues->key, hw_options->name) == 0 &&
+						   (hw_options->argtype == OPTION_HAS_VALUE || hw_options->argtype == OPTION_OPT_VALUE)) {
 							match = 1;
 							break;
 						}
 					}
 					jvalues = jvalues->next;
 				}
-				if(!match) {
+				if(!match && hw_options->argtype == OPTION_OPT_VALUE) {
+					/* Optional settings can be left out */
+				} else if(!match) {
 					logprintf(LOG_ERR, "hardware module #%d \"%s\", setting \"%s\" missing", i, jchilds->key, hw_options->name);
 					have_error = 1;
 					goto clear;
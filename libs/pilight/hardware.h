@@ -32,6 +32,15 @@ typedef enum {
 #include "options.h"
 #include "json.h"
 
+/* A single pulse as captured by a hardware module */
+typedef struct hardware_pulse_t {
+	unsigned long long timestamp; // Edge ending the pulse on the CLOCK_MONOTONIC_RAW in ns, 0 if unknown
+	int duration; // Length in microseconds
+} hardware_pulse_t;
+
+/* Maximum number of pulses read by a single receiveBatch call */
+#define HARDWARE_BATCH_SIZE	256
+
 typedef struct hardware_t {
 	char *id;
 	hwtype_t type;
@@ -39,8 +48,14 @@ typedef struct hardware_t {
 
 	unsigned short (*init)(void);
 	unsigned short (*deinit)(void);
-	int (*receive)(void);
+	int (*receive)(struct hardware_pulse_t *pulse);
+	/* Optional, returns the number of pulses stored in
+	   the buffer of at most max pulses, or -1 on error */
+	int (*receiveBatch)(struct hardware_pulse_t *pulses, int max);
 	int (*send)(int *code);
+	/* Optional, sends a single repeat of rawlen pulses repeats
+	   times in one go so the caller doesn't have to expand it */
+	int (*sendRepeat)(int *code, int rawlen, int repeats);
 	unsigned short (*settings)(JsonNode *json);
 	struct hardware_t *next;
 } hardware_t;
@@ -56,6 +71,7 @@ struct conf_hardware_t *conf_hardware;
 void hardware_init(void);
 void hardware_register(struct hardware_t **hw);
 void hardware_set_id(struct hardware_t *hw, const char *id);
+unsigned long long hardware_timestamp(void);
 int hardware_gc(void);
 int hardware_set_file(char *file);
 int hardware_read(void);
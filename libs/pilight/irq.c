@@ -24,32 +24,33 @@
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
-#include <sys/time.h>
+#include <limits.h>
 #include <unistd.h>
 #include <poll.h>
 
+#include "hardware.h"
 #include "irq.h"
 #include "gc.h"
 #include "log.h"
 #include "wiringPi.h"
 
-typedef struct timestamp_t {
-	unsigned long first;
-	unsigned long second;
-} timestamp_t;
+static unsigned long long timestamp = 0;
 
-timestamp_t timestamp;
+/* Waits for an edge on a specific GPIO pin and returns the time
+   passed since the previous edge in microseconds. The pulse is
+   stamped with the moment the edge was seen. */
+int irq_read(int gpio, struct hardware_pulse_t *pulse) {
+	unsigned long long previous = timestamp, length = 0;
 
-/* Attaches an interrupt handler to a specific GPIO pin
-   Whenever an rising, falling or changing interrupt occurs
-   the function given as the last argument will be called */
-int irq_read(int gpio) {
+	pulse->timestamp = 0;
+	pulse->duration = 0;
 	if(waitForInterrupt(gpio, 1000) > 0) {
-		struct timeval tv;
-		gettimeofday(&tv, NULL);
-		timestamp.first = timestamp.second;
-		timestamp.second = 1000000 * (unsigned int)tv.tv_sec + (unsigned int)tv.tv_usec;
-		return (int)timestamp.second-(int)timestamp.first;
+		timestamp = hardware_timestamp();
+		pulse->timestamp = timestamp;
+		if(previous > 0) {
+			length = (timestamp - previous) / 1000;
+			pulse->duration = (length > INT_MAX) ? INT_MAX : (int)length;
+		}
 	}
-	return 0;
+	return pulse->duration;
 }
@@ -21,7 +21,9 @@
 #ifndef _IRQ_H_
 #define _IRQ_H_
 
-int irq_read(int gpio);
+#include "hardware.h"
+
+int irq_read(int gpio, struct hardware_pulse_t *pulse);
 void irq_interrupt(void);
 
 #endif
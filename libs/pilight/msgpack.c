@@ -0,0 +1,354 @@
+/*
+	Copyright (C) 2013 CurlyMo
+
+	This file is part of pilight.
+
+    pilight is free software: you can redistribute it and/or modify it under the
+	terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later
+	version.
+
+    pilight is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+	A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with pilight. If not, see	<http://www.gnu.org/licenses/>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "../../pilight.h"
+#include "common.h"
+#include "log.h"
+#include "json.h"
+#include "msgpack.h"
+
+typedef struct msgpack_buffer_t {
+	char *data;
+	size_t len;
+	size_t size;
+} msgpack_buffer_t;
+
+static void msgpack_reserve(struct msgpack_buffer_t *buffer, size_t n) {
+	size_t size = (buffer->size == 0) ? 256 : buffer->size;
+
+	if(buffer->len+n <= buffer->size) {
+		return;
+	}
+	while(size < buffer->len+n) {
+		size *= 2;
+	}
+	if(!(buffer->data = realloc(buffer->data, size))) {
+		logprintf(LOG_ERR, "out of memory");
+		exit(EXIT_FAILURE);
+	}
+	buffer->size = size;
+}
+
+/* Write a type byte followed by a big endian value of the given size */
+static void msgpack_put(struct msgpack_buffer_t *buffer, unsigned char type, uint64_t value, unsigned int bytes) {
+	unsigned int i = 0;
+
+	msgpack_reserve(buffer, (size_t)bytes+1);
+	buffer->data[buffer->len++] = (char)type;
+	for(i=bytes;i>0;i--) {
+		buffer->data[buffer->len++] = (char)((value >> ((i-1)*8)) & 0xff);
+	}
+}
+
+static void msgpack_put_string(struct msgpack_buffer_t *buffer, const char *str) {
+	size_t n = strlen(str);
+
+	if(n < 32) {
+		msgpack_put(buffer, (unsigned char)(0xa0 | n), 0, 0);
+	} else if(n <= 0xff) {
+		msgpack_put(buffer, 0xd9, n, 1);
+	} else if(n <= 0xffff) {
+		msgpack_put(buffer, 0xda, n, 2);
+	} else {
+		msgpack_put(buffer, 0xdb, n, 4);
+	}
+	msgpack_reserve(buffer, n);
+	memcpy(&buffer->data[buffer->len], str, n);
+	buffer->len += n;
+}
+
+/* Whole numbers are sent in the smallest integer that holds them */
+static void msgpack_put_number(struct msgpack_buffer_t *buffer, double number) {
+	long long i = 0;
+	uint64_t bits = 0;
+
+	if(number >= -9223372036854775808.0 && number < 9223372036854775808.0) {
+		i = (long long)number;
+		if((double)i <= number && (double)i >= number) {
+			if(i >= 0) {
+				if(i < 128) {
+					msgpack_put(buffer, (unsigned char)i, 0, 0);
+				} else if(i <= 0xff) {
+					msgpack_put(buffer, 0xcc, (uint64_t)i, 1);
+				} else if(i <= 0xffff) {
+					msgpack_put(buffer, 0xcd, (uint64_t)i, 2);
+				} else if(i <= 0xffffffffLL) {
+					msgpack_put(buffer, 0xce, (uint64_t)i, 4);
+				} else {
+					msgpack_put(buffer, 0xcf, (uint64_t)i, 8);
+				}
+			} else if(i >= -32) {
+				msgpack_put(buffer, (unsigned char)(i & 0xff), 0, 0);
+			} else if(i >= -128) {
+				msgpack_put(buffer, 0xd0, (uint64_t)i, 1);
+			} else if(i >= -32768) {
+				msgpack_put(buffer, 0xd1, (uint64_t)i, 2);
+			} else if(i >= -2147483648LL) {
+				msgpack_put(buffer, 0xd2, (uint64_t)i, 4);
+			} else {
+				msgpack_put(buffer, 0xd3, (uint64_t)i, 8);
+			}
+			return;
+		}
+	}
+	memcpy(&bits, &number, sizeof(bits));
+	msgpack_put(buffer, 0xcb, bits, 8);
+}
+
+static void msgpack_put_value(struct msgpack_buffer_t *buffer, const JsonNode *node) {
+	JsonNode *child = NULL;
+	size_t n = 0;
+
+	switch(node->tag) {
+		case JSON_NULL:
+			msgpack_put(buffer, 0xc0, 0, 0);
+		break;
+		case JSON_BOOL:
+			msgpack_put(buffer, (node->bool_ == true) ? 0xc3 : 0xc2, 0, 0);
+		break;
+		case JSON_STRING:
+			msgpack_put_string(buffer, node->string_);
+		break;
+		case JSON_NUMBER:
+			msgpack_put_number(buffer, node->number_);
+		break;
+		case JSON_ARRAY:
+		case JSON_OBJECT:
+			json_foreach(child, node) {
+				n++;
+			}
+			if(n < 16) {
+				msgpack_put(buffer, (unsigned char)(((node->tag == JSON_ARRAY) ? 0x90 : 0x80) | n), 0, 0);
+			} else if(n <= 0xffff) {
+				msgpack_put(buffer, (node->tag == JSON_ARRAY) ? 0xdc : 0xde, n, 2);
+			} else {
+				msgpack_put(buffer, (node->tag == JSON_ARRAY) ? 0xdd : 0xdf, n, 4);
+			}
+			json_foreach(child, node) {
+				if(node->tag == JSON_OBJECT) {
+					msgpack_put_string(buffer, child->key);
+				}
+				msgpack_put_value(buffer, child);
+			}
+		break;
+		default:
+			msgpack_put(buffer, 0xc0, 0, 0);
+		break;
+	}
+}
+
+char *msgpack_encode(const JsonNode *node, size_t header, size_t *len) {
+	struct msgpack_buffer_t buffer;
+
+	memset(&buffer, 0, sizeof(struct msgpack_buffer_t));
+	msgpack_reserve(&buffer, header);
+	buffer.len = header;
+	msgpack_put_value(&buffer, node);
+	*len = buffer.len;
+	return buffer.data;
+}
+
+/* Read a big endian value of the given size */
+static int msgpack_get(char **p, char *end, int bytes, uint64_t *value) {
+	int i = 0;
+
+	if((size_t)(end-*p) < (size_t)bytes) {
+		return -1;
+	}
+	*value = 0;
+	for(i=0;i<bytes;i++) {
+		*value = (*value << 8) | (unsigned char)(*p)[i];
+	}
+	*p += bytes;
+	return 0;
+}
+
+/* The length of a string or binary of the given type */
+static int msgpack_get_string(unsigned char type, char **p, char *end, size_t *n) {
+	uint64_t value = 0;
+
+	if((type & 0xe0) == 0xa0) {
+		value = type & 0x1f;
+	} else if(type == 0xd9 || type == 0xc4) {
+		if(msgpack_get(p, end, 1, &value) != 0) {
+			return -1;
+		}
+	} else if(type == 0xda || type == 0xc5) {
+		if(msgpack_get(p, end, 2, &value) != 0) {
+			return -1;
+		}
+	} else if(type == 0xdb || type == 0xc6) {
+		if(msgpack_get(p, end, 4, &value) != 0) {
+			return -1;
+		}
+	} else {
+		return -1;
+	}
+	if(value > (uint64_t)(end-*p)) {
+		return -1;
+	}
+	*n = (size_t)value;
+	return 0;
+}
+
+static JsonNode *msgpack_get_value(char **p, char *end, int depth) {
+	JsonNode *node = NULL, *child = NULL;
+	unsigned char type = 0;
+	uint64_t value = 0, count = 0, i = 0;
+	size_t n = 0, kn = 0;
+	char *key = NULL, c = 0;
+	double number = 0.0;
+	float single = 0;
+	uint32_t bits = 0;
+
+	if(*p >= end || depth > MSGPACK_DEPTH) {
+		return NULL;
+	}
+	type = (unsigned char)*(*p)++;
+
+	if(type <= 0x7f) {
+		return json_mknumber((double)type);
+	} else if(type >= 0xe0) {
+		return json_mknumber((double)(signed char)type);
+	} else if((type & 0xe0) == 0xa0 || type == 0xd9 || type == 0xda || type == 0xdb ||
+	          type == 0xc4 || type == 0xc5 || type == 0xc6) {
+		if(msgpack_get_string(type, p, end, &n) != 0) {
+			return NULL;
+		}
+		/* Borrow the byte after the string for its terminator */
+		c = (*p)[n];
+		(*p)[n] = '\0';
+		node = json_mkstring(*p);
+		(*p)[n] = c;
+		*p += n;
+		return node;
+	}
+
+	switch(type) {
+		case 0xc0:
+			return json_mknull();
+		case 0xc2:
+			return json_mkbool(false);
+		case 0xc3:
+			return json_mkbool(true);
+		case 0xca:
+			if(msgpack_get(p, end, 4, &value) != 0) {
+				return NULL;
+			}
+			bits = (uint32_t)value;
+			memcpy(&single, &bits, sizeof(single));
+			return json_mknumber((double)single);
+		case 0xcb:
+			if(msgpack_get(p, end, 8, &value) != 0) {
+				return NULL;
+			}
+			memcpy(&number, &value, sizeof(number));
+			return json_mknumber(number);
+		case 0xcc:
+		case 0xcd:
+		case 0xce:
+		case 0xcf:
+			if(msgpack_get(p, end, 1 << (type-0xcc), &value) != 0) {
+				return NULL;
+			}
+			return json_mknumber((double)value);
+		case 0xd0:
+			if(msgpack_get(p, end, 1, &value) != 0) {
+				return NULL;
+			}
+			return json_mknumber((double)(int8_t)value);
+		case 0xd1:
+			if(msgpack_get(p, end, 2, &value) != 0) {
+				return NULL;
+			}
+			return json_mknumber((double)(int16_t)value);
+		case 0xd2:
+			if(msgpack_get(p, end, 4, &value) != 0) {
+				return NULL;
+			}
+			return json_mknumber((double)(int32_t)value);
+		case 0xd3:
+			if(msgpack_get(p, end, 8, &value) != 0) {
+				return NULL;
+			}
+			return json_mknumber((double)(int64_t)value);
+		case 0xdc:
+		case 0xdd:
+		case 0xde:
+		case 0xdf:
+			if(msgpack_get(p, end, (type == 0xdc || type == 0xde) ? 2 : 4, &count) != 0) {
+				return NULL;
+			}
+			type = (type == 0xdc || type == 0xdd) ? 0x90 : 0x80;
+		break;
+		default:
+			if((type & 0xf0) == 0x90 || (type & 0xf0) == 0x80) {
+				count = type & 0x0f;
+				type &= 0xf0;
+			} else {
+				/* Extension types are of no use to us */
+				return NULL;
+			}
+		break;
+	}
+
+	/* Every element takes at least one byte */
+	if(count > (uint64_t)(end-*p)) {
+		return NULL;
+	}
+	node = (type == 0x90) ? json_mkarray() : json_mkobject();
+	for(i=0;i<count;i++) {
+		if(type == 0x80) {
+			if(*p >= end || msgpack_get_string((unsigned char)*(*p)++, p, end, &kn) != 0) {
+				json_delete(node);
+				return NULL;
+			}
+			key = *p;
+			*p += kn;
+		}
+		if((child = msgpack_get_value(p, end, depth+1)) == NULL) {
+			json_delete(node);
+			return NULL;
+		}
+		if(type == 0x90) {
+			json_append_element(node, child);
+		} else {
+			c = key[kn];
+			key[kn] = '\0';
+			json_append_member(node, key, child);
+			key[kn] = c;
+		}
+	}
+	return node;
+}
+
+JsonNode *msgpack_decode(char *buffer, size_t len) {
+	JsonNode *node = NULL;
+	char *p = buffer, *end = &buffer[len];
+
+	if((node = msgpack_get_value(&p, end, 0)) != NULL && p != end) {
+		json_delete(node);
+		node = NULL;
+	}
+	return node;
+}
@@ -0,0 +1,36 @@
+/*
+	Copyright (C) 2013 CurlyMo
+
+	This file is part of pilight.
+
+    pilight is free software: you can redistribute it and/or modify it under the
+	terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later
+	version.
+
+    pilight is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+	A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with pilight. If not, see	<http://www.gnu.org/licenses/>
+*/
+
+#ifndef _MSGPACK_H_
+#define _MSGPACK_H_
+
+#include <stddef.h>
+#include "json.h"
+
+/* Deepest nesting of arrays and objects we decode */
+#define MSGPACK_DEPTH		32
+
+/* Encode a json tree as MessagePack. The first header bytes of the
+   returned buffer are left free for the caller, len includes them. */
+char *msgpack_encode(const JsonNode *node, size_t header, size_t *len);
+/* Returns NULL when the buffer doesn't hold exactly one value. The
+   buffer is briefly modified, so it needs one writable byte beyond
+   len. */
+JsonNode *msgpack_decode(char *buffer, size_t len);
+
+#endif
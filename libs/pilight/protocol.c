@@ -24,6 +24,12 @@
 #include <dlfcn.h>
 #include <pthread.h>
 #include <sys/time.h>
+#ifdef __SSE2__
+	#include <emmintrin.h>
+#endif
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+	#include <arm_neon.h>
+#endif
 
 #include "../../pilight.h"
 #include "common.h"
@@ -36,6 +42,616 @@
 
 #include "protocol_header.h"
 
+#define PROTOCOL_DISPATCH_SIZE		256
+#define PROTOCOL_PLSLEN_WINDOW		16
+#define PROTOCOL_PLSLEN_MARGIN		5
+
+/* Pulse trains are only offered to protocols that share the same
+   hardware type, raw length and pulse length window. The dispatch
+   index below maps these three keys to the candidate protocols so
+   the receive parser doesn't have to walk the full protocol list. */
+typedef struct protocol_candidate_t {
+	struct protocol_t *listener;
+	struct protocol_plslen_t *plslen;
+	int order;
+	struct protocol_candidate_t *next;
+} protocol_candidate_t;
+
+typedef struct protocol_dispatch_t {
+	int hwtype;
+	int rawlen;
+	int window;
+	struct protocol_candidate_t *candidates;
+	struct protocol_candidate_t *tail;
+	struct protocol_dispatch_t *next;
+} protocol_dispatch_t;
+
+/* An index is never changed once it's published, so the decoders and
+   receivers read it without a lock. A change to the protocols retires
+   it until protocol_gc, as a reader may still be using it, and the next
+   decoder builds a new one. */
+typedef struct protocol_index_t {
+	struct protocol_dispatch_t *buckets[PROTOCOL_DISPATCH_SIZE];
+	struct protocol_index_t *next;
+} protocol_index_t;
+
+static struct protocol_index_t *volatile protocol_index = NULL;
+static struct protocol_index_t *protocol_index_retired = NULL;
+static pthread_mutex_t protocol_dispatch_lock = PTHREAD_MUTEX_INITIALIZER;
+/* Set once we told there are more candidates than PROTOCOL_MAX_MATCHES */
+static int protocol_match_overflow = 0;
+
+/* Recently received payloads, so repeats are counted for each
+   remote instead of each protocol. A payload is looked up in the
+   few slots following the one its hash points to, the bits are
+   kept as well so payloads sharing a hash are told apart. */
+#define PROTOCOL_REPEAT_PROBES	4
+
+typedef struct protocol_repeat_t {
+	struct protocol_t *protocol;
+	unsigned int hash;
+	int rawlen;
+	uint64_t bits[BINARY_WORDS(255)];
+	unsigned long long last;
+	unsigned long long reported_at;
+	int repeats;
+	int reported;
+} protocol_repeat_t;
+
+static struct protocol_repeat_t protocol_repeats[RECEIVE_REPEAT_SLOTS];
+static pthread_mutex_t protocol_repeat_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned int protocol_dispatch_hash(int hwtype, int rawlen, int window) {
+	return ((unsigned int)(hwtype+1)*31+(unsigned int)rawlen*131+(unsigned int)window*7) % PROTOCOL_DISPATCH_SIZE;
+}
+
+static void protocol_dispatch_gc(struct protocol_index_t *index) {
+	struct protocol_dispatch_t *dtmp = NULL;
+	struct protocol_candidate_t *ctmp = NULL;
+	int i = 0;
+
+	for(i=0;i<PROTOCOL_DISPATCH_SIZE;i++) {
+		while(index->buckets[i]) {
+			dtmp = index->buckets[i];
+			while(dtmp->candidates) {
+				ctmp = dtmp->candidates;
+				dtmp->candidates = dtmp->candidates->next;
+				sfree((void *)&ctmp);
+			}
+			index->buckets[i] = index->buckets[i]->next;
+			sfree((void *)&dtmp);
+		}
+	}
+	sfree((void *)&index);
+}
+
+static void protocol_dispatch_invalidate(void) {
+	pthread_mutex_lock(&protocol_dispatch_lock);
+	if(protocol_index) {
+		protocol_index->next = protocol_index_retired;
+		protocol_index_retired = protocol_index;
+		protocol_index = NULL;
+	}
+	pthread_mutex_unlock(&protocol_dispatch_lock);
+}
+
+static void protocol_dispatch_add(struct protocol_index_t *index, int hwtype, int rawlen, int window, struct protocol_t *proto, struct protocol_plslen_t *plslen, int order) {
+	unsigned int hash = protocol_dispatch_hash(hwtype, rawlen, window);
+	struct protocol_dispatch_t *dnode = index->buckets[hash];
+	struct protocol_candidate_t *cnode = NULL;
+
+	while(dnode) {
+		if(dnode->hwtype == hwtype && dnode->rawlen == rawlen && dnode->window == window) {
+			break;
+		}
+		dnode = dnode->next;
+	}
+	if(!dnode) {
+		if(!(dnode = malloc(sizeof(struct protocol_dispatch_t)))) {
+			logprintf(LOG_ERR, "out of memory");
+			exit(EXIT_FAILURE);
+		}
+		dnode->hwtype = hwtype;
+		dnode->rawlen = rawlen;
+		dnode->window = window;
+		dnode->candidates = NULL;
+		dnode->tail = NULL;
+		dnode->next = index->buckets[hash];
+		index->buckets[hash] = dnode;
+	}
+
+	if(!(cnode = malloc(sizeof(struct protocol_candidate_t)))) {
+		logprintf(LOG_ERR, "out of memory");
+		exit(EXIT_FAILURE);
+	}
+	cnode->listener = proto;
+	cnode->plslen = plslen;
+	cnode->order = order;
+	cnode->next = NULL;
+
+	/* Keep the candidates in registry order */
+	if(dnode->tail) {
+		dnode->tail->next = cnode;
+	} else {
+		dnode->candidates = cnode;
+	}
+	dnode->tail = cnode;
+}
+
+static struct protocol_index_t *protocol_dispatch_build(void) {
+	struct protocol_index_t *index = NULL;
+	struct protocols_t *pnode = protocols;
+	struct protocol_t *proto = NULL;
+	struct protocol_plslen_t *plslen = NULL;
+	int order = 0, min = 0, max = 0, x = 0, w = 0;
+
+	if(!(index = malloc(sizeof(struct protocol_index_t)))) {
+		logprintf(LOG_ERR, "out of memory");
+		exit(EXIT_FAILURE);
+	}
+	memset(index, 0, sizeof(struct protocol_index_t));
+
+	while(pnode) {
+		proto = pnode->listener;
+		if((((proto->parseRaw || proto->parseCode || proto->decodeRaw || proto->decodeCode) &&
+		   (proto->rawlen > 0 || (proto->minrawlen > 0 && proto->maxrawlen > 0)))
+		   || proto->parseBinary || proto->decodeBinary) && proto->pulse > 0 && proto->plslen) {
+			plslen = proto->plslen;
+			while(plslen) {
+				min = 0;
+				if(plslen->length > PROTOCOL_PLSLEN_MARGIN) {
+					min = (plslen->length-PROTOCOL_PLSLEN_MARGIN)/PROTOCOL_PLSLEN_WINDOW;
+				}
+				max = (plslen->length+PROTOCOL_PLSLEN_MARGIN)/PROTOCOL_PLSLEN_WINDOW;
+				for(w=min;w<=max;w++) {
+					if(proto->rawlen > 0) {
+						protocol_dispatch_add(index, proto->hwtype, proto->rawlen, w, proto, plslen, order);
+					}
+					if(proto->minrawlen > 0 && proto->maxrawlen > 0) {
+						for(x=proto->minrawlen;x<=proto->maxrawlen;x++) {
+							if(x != proto->rawlen) {
+								protocol_dispatch_add(index, proto->hwtype, x, w, proto, plslen, order);
+							}
+						}
+					}
+				}
+				plslen = plslen->next;
+			}
+		}
+		order++;
+		pnode = pnode->next;
+	}
+	return index;
+}
+
+/* The published index, built first when there is none */
+static struct protocol_index_t *protocol_dispatch_get(void) {
+	struct protocol_index_t *index = protocol_index;
+
+	if(index == NULL) {
+		/* Keep the index from being build by two decoders */
+		pthread_mutex_lock(&protocol_dispatch_lock);
+		if((index = protocol_index) == NULL) {
+			index = protocol_dispatch_build();
+			/* Make sure the index is written before it's published */
+			__sync_synchronize();
+			protocol_index = index;
+		}
+		pthread_mutex_unlock(&protocol_dispatch_lock);
+	}
+	__sync_synchronize();
+	return index;
+}
+
+/* Pulse trains without a hardware type (e.g. looped back raw codes)
+   are matched against all protocols, while protocols without a
+   hardware type are matched against all pulse trains */
+static int protocol_dispatch_hwtypes(int hwtype, int *hwtypes) {
+	int nrhw = 0, i = 0;
+
+	if(hwtype == HWINTERNAL) {
+		for(i=HWINTERNAL;i<=API;i++) {
+			hwtypes[nrhw++] = i;
+		}
+	} else {
+		hwtypes[nrhw++] = hwtype;
+		hwtypes[nrhw++] = HWINTERNAL;
+	}
+	return nrhw;
+}
+
+static struct protocol_dispatch_t *protocol_dispatch_find(struct protocol_index_t *index, int hwtype, int rawlen, int window) {
+	struct protocol_dispatch_t *dnode = index->buckets[protocol_dispatch_hash(hwtype, rawlen, window)];
+
+	while(dnode) {
+		if(dnode->hwtype == hwtype && dnode->rawlen == rawlen && dnode->window == window) {
+			break;
+		}
+		dnode = dnode->next;
+	}
+	return dnode;
+}
+
+static int protocol_candidate_match(struct protocol_candidate_t *cnode, int plslen) {
+	return (plslen >= (cnode->plslen->length-PROTOCOL_PLSLEN_MARGIN) &&
+	        plslen <= (cnode->plslen->length+PROTOCOL_PLSLEN_MARGIN));
+}
+
+/* Stores the first size candidates in registry order and returns how
+   many there are, which can be more than size */
+int protocol_match(int hwtype, int rawlen, int plslen, struct protocol_match_t *matches, int size) {
+	struct protocol_index_t *index = protocol_dispatch_get();
+	struct protocol_dispatch_t *dnode = NULL;
+	struct protocol_candidate_t *cnode = NULL;
+	struct protocol_t *last = NULL;
+	int orders[size];
+	int hwtypes[(API-HWINTERNAL)+1];
+	int window = plslen/PROTOCOL_PLSLEN_WINDOW;
+	int nrhw = protocol_dispatch_hwtypes(hwtype, hwtypes);
+	int nr = 0, total = 0, i = 0, x = 0;
+
+	for(x=0;x<nrhw;x++) {
+		if((dnode = protocol_dispatch_find(index, hwtypes[x], rawlen, window)) == NULL) {
+			continue;
+		}
+		/* The pulse lengths of a protocol are next to each other
+		   and only the first matching one counts */
+		last = NULL;
+		cnode = dnode->candidates;
+		while(cnode) {
+			if(cnode->listener != last && protocol_candidate_match(cnode, plslen)) {
+				last = cnode->listener;
+				total++;
+				/* Sorted insert so matches are offered in registry
+				   order, when full the last one makes room */
+				if(nr < size || (nr > 0 && orders[nr-1] > cnode->order)) {
+					i = (nr < size) ? nr++ : nr-1;
+					while(i > 0 && orders[i-1] > cnode->order) {
+						matches[i] = matches[i-1];
+						orders[i] = orders[i-1];
+						i--;
+					}
+					matches[i].listener = cnode->listener;
+					matches[i].plslen = cnode->plslen;
+					orders[i] = cnode->order;
+				}
+			}
+			cnode = cnode->next;
+		}
+	}
+
+	return total;
+}
+
+int protocol_possible(int hwtype, int rawlen, int plslen) {
+	struct protocol_index_t *index = protocol_index;
+	struct protocol_dispatch_t *dnode = NULL;
+	struct protocol_candidate_t *cnode = NULL;
+	int hwtypes[(API-HWINTERNAL)+1];
+	int window = plslen/PROTOCOL_PLSLEN_WINDOW;
+	int nrhw = 0, x = 0;
+
+	if(index == NULL) {
+		return 1;
+	}
+	__sync_synchronize();
+
+	nrhw = protocol_dispatch_hwtypes(hwtype, hwtypes);
+	for(x=0;x<nrhw;x++) {
+		if((dnode = protocol_dispatch_find(index, hwtypes[x], rawlen, window)) == NULL) {
+			continue;
+		}
+		cnode = dnode->candidates;
+		while(cnode) {
+			if(protocol_candidate_match(cnode, plslen)) {
+				return 1;
+			}
+			cnode = cnode->next;
+		}
+	}
+	return 0;
+}
+
+/* Convert the pulses into one's and zero's */
+void protocol_quantize(int *pulses, int rawlen, int threshold, int *code) {
+	int x = 0;
+
+#ifdef __SSE2__
+	__m128i limit = _mm_set1_epi32(threshold-1);
+	__m128i one = _mm_set1_epi32(1);
+	for(x=0;x<(rawlen & ~3);x+=4) {
+		__m128i chunk = _mm_loadu_si128((__m128i *)&pulses[x]);
+		_mm_storeu_si128((__m128i *)&code[x], _mm_and_si128(_mm_cmpgt_epi32(chunk, limit), one));
+	}
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+	int32x4_t limit = vdupq_n_s32(threshold);
+	for(x=0;x<(rawlen & ~3);x+=4) {
+		uint32x4_t mask = vcgeq_s32(vld1q_s32(&pulses[x]), limit);
+		vst1q_s32(&code[x], vreinterpretq_s32_u32(vshrq_n_u32(mask, 31)));
+	}
+#endif
+	for(;x<rawlen;x++) {
+		code[x] = (pulses[x] >= threshold) ? 1 : 0;
+	}
+}
+
+void protocol_quantize_init(struct protocol_quantize_t *cache, int *pulses, int rawlen) {
+	cache->raw = pulses;
+	cache->rawlen = rawlen;
+	cache->nr = 0;
+}
+
+/* Candidate protocols sharing the same threshold
+   share a single pass over the pulse train */
+void protocol_quantize_cached(struct protocol_quantize_t *cache, int threshold, int *code) {
+	int i = 0;
+	for(i=0;i<cache->nr;i++) {
+		if(cache->threshold[i] == threshold) {
+			memcpy(code, cache->code[i], sizeof(int)*(size_t)cache->rawlen);
+			return;
+		}
+	}
+	if(cache->nr < PROTOCOL_QUANTIZE_CACHE) {
+		protocol_quantize(cache->raw, cache->rawlen, threshold, cache->code[cache->nr]);
+		cache->threshold[cache->nr] = threshold;
+		memcpy(code, cache->code[cache->nr], sizeof(int)*(size_t)cache->rawlen);
+		cache->nr++;
+	} else {
+		protocol_quantize(cache->raw, cache->rawlen, threshold, code);
+	}
+}
+
+/* Lets the legacy module callbacks, which work on the
+   protocol struct itself, use the given decode context */
+void protocol_bind(protocol_t *proto, struct protocol_decode_t *decode) {
+	pthread_mutex_lock(&proto->lock);
+	proto->raw = decode->raw;
+	proto->code = decode->code;
+	proto->binary = decode->binary;
+	proto->message = decode->message;
+}
+
+void protocol_unbind(protocol_t *proto, struct protocol_decode_t *decode) {
+	decode->message = proto->message;
+	proto->message = NULL;
+	proto->raw = NULL;
+	proto->code = NULL;
+	proto->binary = NULL;
+	pthread_mutex_unlock(&proto->lock);
+}
+
+int protocol_parse_raw(protocol_t *proto, struct protocol_decode_t *decode) {
+	if(proto->decodeRaw) {
+		proto->decodeRaw(decode);
+	} else if(proto->parseRaw) {
+		protocol_bind(proto, decode);
+		proto->parseRaw();
+		protocol_unbind(proto, decode);
+	} else {
+		return -1;
+	}
+	return 0;
+}
+
+int protocol_parse_code(protocol_t *proto, struct protocol_decode_t *decode) {
+	if(proto->decodeCode) {
+		proto->decodeCode(decode);
+	} else if(proto->parseCode) {
+		protocol_bind(proto, decode);
+		proto->parseCode();
+		protocol_unbind(proto, decode);
+	} else {
+		return -1;
+	}
+	return 0;
+}
+
+int protocol_parse_binary(protocol_t *proto, struct protocol_decode_t *decode) {
+	if(proto->decodeBinary) {
+		proto->decodeBinary(decode);
+	} else if(proto->parseBinary) {
+		protocol_bind(proto, decode);
+		proto->parseBinary();
+		protocol_unbind(proto, decode);
+	} else {
+		return -1;
+	}
+	return 0;
+}
+
+static int protocol_decode_done(protocol_t *proto, struct protocol_decode_t *decode, protocol_decoded_t *callback, void *param) {
+	int found = (decode->message != NULL) ? 1 : 0;
+
+	if(callback) {
+		callback(proto, decode, param);
+	}
+	if(decode->message) {
+		json_delete(decode->message);
+	}
+	decode->message = NULL;
+	return found;
+}
+
+static unsigned int protocol_repeat_hash(int *code, int rawlen) {
+	unsigned int hash = 2166136261U;
+	int x = 0;
+
+	for(x=0;x<rawlen;x++) {
+		hash = (hash ^ (unsigned int)code[x]) * 16777619U;
+	}
+	return (hash ^ (unsigned int)rawlen) * 16777619U;
+}
+
+static int protocol_repeat_same(struct protocol_repeat_t *slot, struct protocol_t *protocol, unsigned int hash, uint64_t *bits, int rawlen) {
+	return (slot->protocol == protocol && slot->hash == hash && slot->rawlen == rawlen &&
+	        memcmp(slot->bits, bits, sizeof(uint64_t)*BINARY_WORDS((size_t)rawlen)) == 0);
+}
+
+/* Should be called with the protocol_repeat_lock held. Counts another
+   repeat of a payload, or starts a new press when it hasn't been
+   received for a while. A button that is held down is handed out
+   again once the timeout has passed since it was last handed out. */
+static struct protocol_repeat_t *protocol_repeat(struct protocol_t *protocol, unsigned int hash, uint64_t *bits, int rawlen, unsigned long long timestamp) {
+	struct protocol_repeat_t *slot = NULL, *oldest = NULL;
+	unsigned long long gap = 0, timeout = RECEIVE_REPEAT_TIMEOUT*1000000ULL;
+	int i = 0;
+
+	for(i=0;i<PROTOCOL_REPEAT_PROBES;i++) {
+		slot = &protocol_repeats[(hash+(unsigned int)i) & (RECEIVE_REPEAT_SLOTS-1)];
+		if(protocol_repeat_same(slot, protocol, hash, bits, rawlen)) {
+			break;
+		}
+		if(oldest == NULL || slot->protocol == NULL ||
+		   (oldest->protocol != NULL && slot->last < oldest->last)) {
+			oldest = slot;
+		}
+		slot = NULL;
+	}
+
+	if(slot) {
+		/* Receivers can hand in their pulse trains out of order */
+		gap = (timestamp > slot->last) ? timestamp - slot->last : slot->last - timestamp;
+		if(gap > timeout || (slot->reported == 1 && timestamp > slot->reported_at &&
+		   timestamp - slot->reported_at > timeout)) {
+			slot->repeats = 0;
+			slot->reported = 0;
+		}
+	} else {
+		slot = oldest;
+		slot->protocol = protocol;
+		slot->hash = hash;
+		slot->rawlen = rawlen;
+		memcpy(slot->bits, bits, sizeof(uint64_t)*BINARY_WORDS((size_t)rawlen));
+		slot->repeats = 0;
+		slot->reported = 0;
+	}
+	if(timestamp > slot->last || slot->repeats == 0) {
+		slot->last = timestamp;
+	}
+	slot->repeats++;
+	return slot;
+}
+
+/* Offer a pulse train to all matching protocols. The callback is called
+   after each parse with the decode context holding the message, which
+   the callback may take over by resetting decode->message. The timestamp
+   is the monotonic time in ns at which the pulse train was received.
+   Only the first pulse train of a press that reaches the minimum number
+   of repeats is parsed, unless minrepeats is zero. */
+int protocol_decode(int hwtype, int *pulses, int rawlen, int plslen, unsigned long long timestamp, int minrepeats, protocol_decoded_t *callback, void *param) {
+	struct protocol_t *protocol = NULL;
+	struct protocol_plslen_t *plslengths = NULL;
+	struct protocol_match_t matches[PROTOCOL_MAX_MATCHES];
+	struct protocol_decode_t decode;
+	struct protocol_quantize_t quantize;
+	struct protocol_repeat_t *repeat = NULL;
+	uint64_t bits[BINARY_WORDS(255)];
+	unsigned int hash = 0;
+	int x = 0, i = 0, nrbits = 0, nrmatches = 0, found = 0, parsed = 0, claimed = 0;
+
+	/* Only offer the pulse train to the protocols with a
+	   matching hardware type, raw length and pulse length */
+	nrmatches = protocol_match(hwtype, rawlen, plslen, matches, PROTOCOL_MAX_MATCHES);
+	if(nrmatches > PROTOCOL_MAX_MATCHES) {
+		if(__sync_bool_compare_and_swap(&protocol_match_overflow, 0, 1)) {
+			logprintf(LOG_NOTICE, "%d protocols match a pulse train of %d pulses, only the first %d are tried", nrmatches, rawlen, PROTOCOL_MAX_MATCHES);
+		}
+		nrmatches = PROTOCOL_MAX_MATCHES;
+	}
+	protocol_quantize_init(&quantize, pulses, rawlen);
+
+	for(i=0;i<nrmatches;i++) {
+		protocol = matches[i].listener;
+		plslengths = matches[i].plslen;
+
+		for(x=0;x<rawlen;x++) {
+			if(x < 254) {
+				memcpy(&decode.raw[x], &pulses[x], sizeof(int));
+			}
+		}
+		decode.rawlen = rawlen;
+		decode.plslen = plslen;
+		decode.message = NULL;
+
+		if(protocol->parseRaw || protocol->decodeRaw) {
+			logprintf(LOG_DEBUG, "recevied pulse length of %d", plslen);
+			logprintf(LOG_DEBUG, "called %s parseRaw()", protocol->id);
+			protocol_parse_raw(protocol, &decode);
+			decode.repeats = -1;
+			found += protocol_decode_done(protocol, &decode, callback, param);
+		}
+
+		/* Convert the raw codes to one's and zero's */
+		if(protocol->parseRaw || protocol->decodeRaw) {
+			/* The raw codes could have been altered */
+			protocol_quantize(decode.raw, rawlen, (plslengths->length * (1+protocol->pulse)/2), decode.code);
+		} else {
+			protocol_quantize_cached(&quantize, (plslengths->length * (1+protocol->pulse)/2), decode.code);
+		}
+
+		/* The repeat state is shared by all decoders */
+		hash = protocol_repeat_hash(decode.code, rawlen);
+		binPack(decode.code, rawlen, bits);
+		claimed = 0;
+		pthread_mutex_lock(&protocol_repeat_lock);
+		repeat = protocol_repeat(protocol, hash, bits, rawlen, timestamp);
+		decode.repeats = repeat->repeats;
+		if(minrepeats > 0 && repeat->reported == 0 &&
+		   decode.repeats >= (minrepeats*protocol->rxrpt)) {
+			repeat->reported = 1;
+			repeat->reported_at = timestamp;
+			claimed = 1;
+		}
+		pthread_mutex_unlock(&protocol_repeat_lock);
+
+		/* Continue if we have recognized enough repeated codes */
+		if(claimed == 1 || minrepeats <= 0 ||
+		   strcmp(protocol->id, "pilight_firmware") == 0) {
+			parsed = found;
+			if(protocol->parseCode || protocol->decodeCode) {
+				logprintf(LOG_DEBUG, "caught minimum # of repeats %d of %s", decode.repeats, protocol->id);
+				logprintf(LOG_DEBUG, "called %s parseCode()", protocol->id);
+				protocol_parse_code(protocol, &decode);
+				found += protocol_decode_done(protocol, &decode, callback, param);
+			}
+
+			if(protocol->parseBinary || protocol->decodeBinary) {
+				/* Convert the one's and zero's into packed binary words */
+				nrbits = binPackCode(decode.code, rawlen, protocol->lsb, 4, decode.packed);
+				if(protocol->decodeBinary == NULL) {
+					/* The legacy callbacks still read one int per bit */
+					for(x=0;x<nrbits;x++) {
+						decode.binary[x] = (decode.code[(x*4)+protocol->lsb] == 1);
+					}
+				}
+
+				if((double)decode.raw[1]/((plslengths->length * (1+protocol->pulse)/2)) < 2.1) {
+					nrbits--;
+				}
+
+				/* Check if the binary matches the binary length */
+				if((protocol->binlen > 0 && (nrbits == protocol->binlen))
+				   || (protocol->binlen == 0 && (nrbits == protocol->rawlen/4))) {
+					logprintf(LOG_DEBUG, "called %s parseBinary()", protocol->id);
+
+					protocol_parse_binary(protocol, &decode);
+					found += protocol_decode_done(protocol, &decode, callback, param);
+				}
+			}
+
+			/* Let a next repeat try again when nothing could be parsed */
+			if(claimed == 1 && found == parsed) {
+				pthread_mutex_lock(&protocol_repeat_lock);
+				if(protocol_repeat_same(repeat, protocol, hash, bits, rawlen)) {
+					repeat->reported = 0;
+				}
+				pthread_mutex_unlock(&protocol_repeat_lock);
+			}
+		}
+	}
+	return found;
+}
+
 void protocol_remove(char *name) {
 	struct protocols_t *currP, *prevP;
 
@@ -52,7 +668,15 @@ void protocol_remove(char *name) {
 
 			struct protocol_devices_t *dtmp;
 			struct protocol_plslen_t *ttmp;
+			int i = 0;
 			logprintf(LOG_DEBUG, "removed protocol %s", currP->listener->id);
+			pthread_mutex_lock(&protocol_repeat_lock);
+			for(i=0;i<RECEIVE_REPEAT_SLOTS;i++) {
+				if(protocol_repeats[i].protocol == currP->listener) {
+					memset(&protocol_repeats[i], 0, sizeof(struct protocol_repeat_t));
+				}
+			}
+			pthread_mutex_unlock(&protocol_repeat_lock);
 			if(currP->listener->threadGC) {
 				currP->listener->threadGC();
 				logprintf(LOG_DEBUG, "stopped protocol threads");
@@ -82,9 +706,12 @@ void protocol_remove(char *name) {
 				}
 			}
 			sfree((void *)&currP->listener->devices);
+			pthread_mutex_destroy(&currP->listener->lock);
+			pthread_mutexattr_destroy(&currP->listener->attr);
 			sfree((void *)&currP->listener);
 			sfree((void *)&currP);
 
+			protocol_dispatch_invalidate();
 			break;
 		}
 	}
@@ -203,6 +830,9 @@ void protocol_register(protocol_t **proto) {
 	(*proto)->parseRaw = NULL;
 	(*proto)->parseBinary = NULL;
 	(*proto)->parseCode = NULL;
+	(*proto)->decodeRaw = NULL;
+	(*proto)->decodeBinary = NULL;
+	(*proto)->decodeCode = NULL;
 	(*proto)->createCode = NULL;
 	(*proto)->checkValues = NULL;
 	(*proto)->initDev = NULL;
@@ -212,14 +842,14 @@ void protocol_register(protocol_t **proto) {
 	(*proto)->message = NULL;
 	(*proto)->threads = NULL;
 
-	(*proto)->repeats = 0;
-	(*proto)->first = 0;
-	(*proto)->second = 0;
 
-	memset(&(*proto)->raw[0], 0, sizeof((*proto)->raw));
-	memset(&(*proto)->code[0], 0, sizeof((*proto)->code));
-	memset(&(*proto)->pCode[0], 0, sizeof((*proto)->pCode));
-	memset(&(*proto)->binary[0], 0, sizeof((*proto)->binary));
+	(*proto)->raw = NULL;
+	(*proto)->code = NULL;
+	(*proto)->binary = NULL;
+
+	pthread_mutexattr_init(&(*proto)->attr);
+	pthread_mutexattr_settype(&(*proto)->attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&(*proto)->lock, &(*proto)->attr);
 
 	struct protocols_t *pnode = malloc(sizeof(struct protocols_t));
 	if(!pnode) {
@@ -233,6 +863,8 @@ void protocol_register(protocol_t **proto) {
 	}
 	pnode->next = protocols;
 	protocols = pnode;
+
+	protocol_dispatch_invalidate();
 }
 
 struct protocol_threads_t *protocol_thread_init(protocol_t *proto, struct JsonNode *param) {
@@ -312,6 +944,8 @@ void protocol_plslen_add(protocol_t *proto, int plslen) {
 	pnode->length = plslen;
 	pnode->next	= proto->plslen;
 	proto->plslen = pnode;
+
+	protocol_dispatch_invalidate();
 }
 
 void protocol_device_add(protocol_t *proto, const char *id, const char *desc) {
@@ -351,6 +985,7 @@ int protocol_gc(void) {
 	struct protocols_t *ptmp;
 	struct protocol_devices_t *dtmp;
 	struct protocol_plslen_t *ttmp;
+	struct protocol_index_t *index = NULL;
 
 	while(protocols) {
 		ptmp = protocols;
@@ -384,12 +1019,26 @@ int protocol_gc(void) {
 			}
 		}
 		sfree((void *)&ptmp->listener->devices);
+		pthread_mutex_destroy(&ptmp->listener->lock);
+		pthread_mutexattr_destroy(&ptmp->listener->attr);
 		sfree((void *)&ptmp->listener);
 		protocols = protocols->next;
 		sfree((void *)&ptmp);
 	}
 	sfree((void *)&protocols);
 
+	pthread_mutex_lock(&protocol_dispatch_lock);
+	if(protocol_index) {
+		protocol_dispatch_gc(protocol_index);
+		protocol_index = NULL;
+	}
+	while(protocol_index_retired) {
+		index = protocol_index_retired;
+		protocol_index_retired = protocol_index_retired->next;
+		protocol_dispatch_gc(index);
+	}
+	pthread_mutex_unlock(&protocol_dispatch_lock);
+
 	logprintf(LOG_DEBUG, "garbage collected protocol library");
 	return EXIT_SUCCESS;
 }
@@ -24,6 +24,7 @@
 #include "options.h"
 #include "threads.h"
 #include "hardware.h"
+#include "binary.h"
 #include "json.h"
 
 typedef enum {
@@ -62,6 +63,19 @@ typedef struct protocol_threads_t {
 	struct protocol_threads_t *next;
 } protocol_threads_t;
 
+/* Scratch state of a single decoding run. Every decoder uses
+   its own context so pulse trains can be decoded concurrently. */
+typedef struct protocol_decode_t {
+	int raw[255];
+	int code[255];
+	int binary[128]; // Max. the half the raw length
+	uint64_t packed[BINARY_WORDS(128)]; // The binary as packed bits
+	int rawlen;
+	int plslen;
+	int repeats;
+	JsonNode *message;
+} protocol_decode_t;
+
 typedef struct protocol_t {
 	char *id;
 	int header;
@@ -80,16 +94,15 @@ typedef struct protocol_t {
 	struct options_t *options;
 	JsonNode *message;
 
-	int repeats;
-	unsigned long first;
-	unsigned long second;
-
 	int bit;
 	int recording;
-	int raw[255];
-	int code[255];
-	int pCode[255];
-	int binary[128]; // Max. the half the raw length
+	/* Only valid while a decode context is bound
+	   to the protocol by protocol_bind() */
+	int *raw;
+	int *code;
+	int *binary;
+	pthread_mutex_t lock;
+	pthread_mutexattr_t attr;
 
 	hwtype_t hwtype;
 	devtype_t devtype;
@@ -99,6 +112,9 @@ typedef struct protocol_t {
 	void (*parseRaw)(void);
 	void (*parseCode)(void);
 	void (*parseBinary)(void);
+	void (*decodeRaw)(struct protocol_decode_t *decode);
+	void (*decodeCode)(struct protocol_decode_t *decode);
+	void (*decodeBinary)(struct protocol_decode_t *decode);
 	int (*createCode)(JsonNode *code);
 	int (*checkValues)(JsonNode *code);
 	struct threadqueue_t *(*initDev)(JsonNode *device);
@@ -113,6 +129,27 @@ typedef struct protocols_t {
 	struct protocols_t *next;
 } protocols_t;
 
+typedef struct protocol_match_t {
+	struct protocol_t *listener;
+	struct protocol_plslen_t *plslen;
+} protocol_match_t;
+
+#define PROTOCOL_MAX_MATCHES	32
+#define PROTOCOL_QUANTIZE_CACHE	8
+
+/* The one's and zero's of a single pulse train
+   for the different thresholds of the candidates */
+typedef struct protocol_quantize_t {
+	int *raw;
+	int rawlen;
+	int nr;
+	int threshold[PROTOCOL_QUANTIZE_CACHE];
+	int code[PROTOCOL_QUANTIZE_CACHE][255];
+} protocol_quantize_t;
+
+/* Called for every parsed pulse train, the message is in decode->message */
+typedef void (protocol_decoded_t)(struct protocol_t *proto, struct protocol_decode_t *decode, void *param);
+
 struct protocols_t *protocols;
 
 void protocol_init(void);
@@ -123,6 +160,20 @@ void protocol_thread_stop(protocol_t *proto);
 void protocol_set_id(protocol_t *proto, const char *id);
 void protocol_plslen_add(protocol_t *proto, int plslen);
 void protocol_register(protocol_t **proto);
+void protocol_remove(char *name);
+int protocol_match(int hwtype, int rawlen, int plslen, struct protocol_match_t *matches, int size);
+/* Whether any protocol could match, without ever waiting for a lock.
+   Until a decoder has built the index everything could. */
+int protocol_possible(int hwtype, int rawlen, int plslen);
+void protocol_quantize(int *pulses, int rawlen, int threshold, int *code);
+void protocol_quantize_init(struct protocol_quantize_t *cache, int *pulses, int rawlen);
+void protocol_quantize_cached(struct protocol_quantize_t *cache, int threshold, int *code);
+void protocol_bind(protocol_t *proto, struct protocol_decode_t *decode);
+void protocol_unbind(protocol_t *proto, struct protocol_decode_t *decode);
+int protocol_parse_raw(protocol_t *proto, struct protocol_decode_t *decode);
+int protocol_parse_code(protocol_t *proto, struct protocol_decode_t *decode);
+int protocol_parse_binary(protocol_t *proto, struct protocol_decode_t *decode);
+int protocol_decode(int hwtype, int *pulses, int rawlen, int plslen, unsigned long long timestamp, int minrepeats, protocol_decoded_t *callback, void *param);
 void protocol_device_add(protocol_t *proto, const char *id, const char *desc);
 int protocol_device_exists(protocol_t *proto, const char *id);
 int protocol_gc(void);
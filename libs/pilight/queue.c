@@ -0,0 +1,239 @@
+/*
+	Copyright (C) 2013 CurlyMo
+
+	This file is part of pilight.
+
+    pilight is free software: you can redistribute it and/or modify it under the
+	terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later
+	version.
+
+    pilight is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+	A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with pilight. If not, see	<http://www.gnu.org/licenses/>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "../../pilight.h"
+#include "common.h"
+#include "log.h"
+#include "json.h"
+#include "hardware.h"
+#include "queue.h"
+
+/* Stored in front of every node handed out */
+typedef struct queue_node_t {
+	unsigned long long queued;
+	int dequeued;
+} queue_node_t;
+
+#define QUEUE_HEADER	((sizeof(struct queue_node_t)+15) & ~(size_t)15)
+
+static struct queue_t *queues = NULL;
+static pthread_mutex_t queues_lock = PTHREAD_MUTEX_INITIALIZER;
+
+struct queue_t *queue_create(const char *name, int size, size_t nodesize) {
+	struct queue_t *queue = NULL;
+	int i = 0;
+
+	if(!(queue = malloc(sizeof(struct queue_t)))) {
+		logprintf(LOG_ERR, "out of memory");
+		exit(EXIT_FAILURE);
+	}
+	memset(queue, 0, sizeof(struct queue_t));
+	if(!(queue->name = malloc(strlen(name)+1))) {
+		logprintf(LOG_ERR, "out of memory");
+		exit(EXIT_FAILURE);
+	}
+	strcpy(queue->name, name);
+	queue->size = size;
+	queue->nodesize = nodesize;
+
+	if(nodesize > 0) {
+		nodesize = QUEUE_HEADER+((nodesize+15) & ~(size_t)15);
+		if(!(queue->nodes = malloc(nodesize*(size_t)size))) {
+			logprintf(LOG_ERR, "out of memory");
+			exit(EXIT_FAILURE);
+		}
+		if(!(queue->free = malloc(sizeof(void *)*(size_t)size))) {
+			logprintf(LOG_ERR, "out of memory");
+			exit(EXIT_FAILURE);
+		}
+		for(i=0;i<size;i++) {
+			queue->free[i] = &queue->nodes[nodesize*(size_t)(size-i-1)];
+		}
+		queue->nrfree = size;
+	}
+
+	pthread_mutexattr_init(&queue->attr);
+	pthread_mutexattr_settype(&queue->attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&queue->lock, &queue->attr);
+
+	pthread_mutex_lock(&queues_lock);
+	queue->next = queues;
+	queues = queue;
+	pthread_mutex_unlock(&queues_lock);
+
+	return queue;
+}
+
+/* Should be called with the queue lock held or by the only consumer */
+static void queue_latency(struct queue_t *queue, unsigned long long queued) {
+	unsigned long long now = hardware_timestamp(), latency = 0, bound = 1000000ULL;
+	int i = 0;
+
+	if(now > queued) {
+		latency = now - queued;
+	}
+	if(latency > queue->latency_max) {
+		queue->latency_max = latency;
+	}
+	for(i=0;i<QUEUE_HISTOGRAM-1;i++) {
+		if(latency < bound) {
+			break;
+		}
+		bound *= 4;
+	}
+	queue->latency[i]++;
+}
+
+/* Should be called with the queue lock held */
+static int queue_enqueue(struct queue_t *queue) {
+	if(queue->number >= queue->size) {
+		queue->dropped++;
+		return -1;
+	}
+	queue->number++;
+	queue->enqueued++;
+	if(queue->number > queue->highwater) {
+		queue->highwater = queue->number;
+	}
+	return 0;
+}
+
+void *queue_alloc(struct queue_t *queue) {
+	struct queue_node_t *header = NULL;
+
+	pthread_mutex_lock(&queue->lock);
+	if(queue->nrfree == 0 || queue_enqueue(queue) != 0) {
+		pthread_mutex_unlock(&queue->lock);
+		return NULL;
+	}
+	header = queue->free[--queue->nrfree];
+	pthread_mutex_unlock(&queue->lock);
+
+	header->queued = hardware_timestamp();
+	header->dequeued = 0;
+	memset((unsigned char *)header+QUEUE_HEADER, 0, queue->nodesize);
+	return (unsigned char *)header+QUEUE_HEADER;
+}
+
+void queue_dequeued(struct queue_t *queue, void *node) {
+	struct queue_node_t *header = (struct queue_node_t *)((unsigned char *)node-QUEUE_HEADER);
+
+	pthread_mutex_lock(&queue->lock);
+	if(header->dequeued == 0) {
+		header->dequeued = 1;
+		queue_latency(queue, header->queued);
+	}
+	pthread_mutex_unlock(&queue->lock);
+}
+
+void queue_free(struct queue_t *queue, void *node) {
+	pthread_mutex_lock(&queue->lock);
+	queue->free[queue->nrfree++] = (unsigned char *)node-QUEUE_HEADER;
+	queue->number--;
+	pthread_mutex_unlock(&queue->lock);
+}
+
+void queue_push(struct queue_t *queue) {
+	int number = (int)(queue->enqueued+1-queue->dequeued);
+
+	queue->enqueued++;
+	if(number > queue->highwater) {
+		queue->highwater = number;
+	}
+}
+
+void queue_drop(struct queue_t *queue) {
+	queue->dropped++;
+}
+
+void queue_pop(struct queue_t *queue, unsigned long long queued) {
+	queue->dequeued++;
+	queue_latency(queue, queued);
+}
+
+/* Add the statistics of all queues since they were created to json */
+void queue_stats(JsonNode *json) {
+	struct queue_t *tmp = NULL;
+	JsonNode *jqueue = NULL, *jlatency = NULL;
+	char name[16];
+	int i = 0, bound = 1;
+
+	pthread_mutex_lock(&queues_lock);
+	tmp = queues;
+	while(tmp) {
+		jqueue = json_mkobject();
+		jlatency = json_mkobject();
+
+		pthread_mutex_lock(&tmp->lock);
+		json_append_member(jqueue, "size", json_mknumber(tmp->size));
+		if(tmp->nodesize > 0) {
+			json_append_member(jqueue, "number", json_mknumber(tmp->number));
+		} else {
+			json_append_member(jqueue, "number", json_mknumber((double)(tmp->enqueued-tmp->dequeued)));
+		}
+		json_append_member(jqueue, "highwater", json_mknumber(tmp->highwater));
+		json_append_member(jqueue, "enqueued", json_mknumber((double)tmp->enqueued));
+		json_append_member(jqueue, "dropped", json_mknumber((double)tmp->dropped));
+		json_append_member(jqueue, "latency-max", json_mknumber((double)tmp->latency_max/1000000.0));
+		bound = 1;
+		for(i=0;i<QUEUE_HISTOGRAM;i++) {
+			if(i < QUEUE_HISTOGRAM-1) {
+				snprintf(name, sizeof(name), "%dms", bound);
+			} else {
+				strcpy(name, "slower");
+			}
+			json_append_member(jlatency, name, json_mknumber((double)tmp->latency[i]));
+			bound *= 4;
+		}
+		pthread_mutex_unlock(&tmp->lock);
+
+		json_append_member(jqueue, "latency", jlatency);
+		json_append_member(json, tmp->name, jqueue);
+		tmp = tmp->next;
+	}
+	pthread_mutex_unlock(&queues_lock);
+}
+
+int queue_gc(void) {
+	struct queue_t *tmp = NULL;
+
+	pthread_mutex_lock(&queues_lock);
+	while(queues) {
+		tmp = queues;
+		queues = queues->next;
+		pthread_mutex_destroy(&tmp->lock);
+		pthread_mutexattr_destroy(&tmp->attr);
+		if(tmp->nodes) {
+			sfree((void *)&tmp->nodes);
+		}
+		if(tmp->free) {
+			sfree((void *)&tmp->free);
+		}
+		sfree((void *)&tmp->name);
+		sfree((void *)&tmp);
+	}
+	pthread_mutex_unlock(&queues_lock);
+
+	logprintf(LOG_DEBUG, "garbage collected queue library");
+	return EXIT_SUCCESS;
+}
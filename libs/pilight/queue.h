@@ -0,0 +1,71 @@
+/*
+	Copyright (C) 2013 CurlyMo
+
+	This file is part of pilight.
+
+    pilight is free software: you can redistribute it and/or modify it under the
+	terms of the GNU General Public License as published by the Free Software
+	Foundation, either version 3 of the License, or (at your option) any later
+	version.
+
+    pilight is distributed in the hope that it will be useful, but WITHOUT ANY
+	WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+	A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with pilight. If not, see	<http://www.gnu.org/licenses/>
+*/
+
+#ifndef _QUEUE_H_
+#define _QUEUE_H_
+
+#include <pthread.h>
+#include "json.h"
+
+/* Number of latency buckets, each four times wider than the
+   previous one starting at 1ms. The last holds the rest. */
+#define QUEUE_HISTOGRAM		8
+
+/* A bounded queue with all its nodes allocated up front. The queue
+   only hands out and takes back nodes, linking them is left to the
+   user so every queue can keep its own order. Queues that already
+   have their own storage only use the accounting. */
+typedef struct queue_t {
+	char *name;
+	int size;
+	size_t nodesize;
+	unsigned char *nodes;
+	void **free;
+	int nrfree;
+
+	int number;
+	int highwater;
+	/* Without nodes of their own the producer only writes
+	   enqueued, dropped and highwater, the consumer the rest */
+	volatile unsigned long enqueued;
+	volatile unsigned long dequeued;
+	volatile unsigned long dropped;
+	unsigned long latency[QUEUE_HISTOGRAM];
+	unsigned long long latency_max;
+
+	pthread_mutex_t lock;
+	pthread_mutexattr_t attr;
+	struct queue_t *next;
+} queue_t;
+
+struct queue_t *queue_create(const char *name, int size, size_t nodesize);
+/* Returns a zeroed node, or NULL when the queue is full */
+void *queue_alloc(struct queue_t *queue);
+/* Account the time a node has been waiting in the queue */
+void queue_dequeued(struct queue_t *queue, void *node);
+void queue_free(struct queue_t *queue, void *node);
+/* Accounting only, for single-producer, single-consumer queues that
+   do their own full check. These never take the queue lock, so only
+   the producer may push or drop and only the consumer may pop. */
+void queue_push(struct queue_t *queue);
+void queue_drop(struct queue_t *queue);
+void queue_pop(struct queue_t *queue, unsigned long long queued);
+void queue_stats(JsonNode *json);
+int queue_gc(void);
+
+#endif
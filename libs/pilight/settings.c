@@ -156,8 +156,10 @@ int settings_parse(JsonNode *root) {
 	while(jsettings) {
 		if(strcmp(jsettings->key, "port") == 0
 		   || strcmp(jsettings->key, "send-repeats") == 0
-		   || strcmp(jsettings->key, "receive-repeats") == 0) {
-			if((int)jsettings->number_ == 0) {
+		   || strcmp(jsettings->key, "receive-repeats") == 0
+		   || strcmp(jsettings->key, "receive-workers") == 0
+		   || strcmp(jsettings->key, "receive-min-pulse") == 0) {
+			if((int)jsettings->number_ <= 0) {
 				logprintf(LOG_ERR, "setting \"%s\" must contain a number larger than 0", jsettings->key);
 				have_error = 1;
 				goto clear;
@@ -185,7 +187,8 @@ int settings_parse(JsonNode *root) {
 			} else {
 				settings_add_string(jsettings->key, jsettings->string_);
 			}
-		} else if(strcmp(jsettings->key, "standalone") == 0) {
+		} else if(strcmp(jsettings->key, "standalone") == 0
+		   || strcmp(jsettings->key, "receive-filter") == 0) {
 			if(jsettings->number_ < 0 || jsettings->number_ > 1) {
 				logprintf(LOG_ERR, "setting \"%s\" must be either 0 or 1", jsettings->key);
 				have_error = 1;
@@ -223,6 +226,19 @@ int settings_parse(JsonNode *root) {
 					settings_add_string(jsettings->key, jsettings->string_);
 				}
 			}
+		} else if(strcmp(jsettings->key, "socket-file") == 0) {
+			/* An empty path disables the local socket */
+			if(!jsettings->string_) {
+				logprintf(LOG_ERR, "setting \"%s\" must contain a file path", jsettings->key);
+				have_error = 1;
+				goto clear;
+			} else if(strlen(jsettings->string_) > 0 && (jsettings->string_[0] != '/' || path_exists(jsettings->string_) != EXIT_SUCCESS)) {
+				logprintf(LOG_ERR, "setting \"%s\" must point to an existing folder", jsettings->key);
+				have_error = 1;
+				goto clear;
+			} else {
+				settings_add_string(jsettings->key, jsettings->string_);
+			}
 		} else if(strcmp(jsettings->key, "config-file") == 0 || strcmp(jsettings->key, "hardware-file") == 0) {
 			if(!jsettings->string_) {
 				logprintf(LOG_ERR, "setting \"%s\" must contain an existing file path", jsettings->key);
@@ -29,26 +29,231 @@
 #include <math.h>
 #include <string.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <sys/time.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <netdb.h>
 #include <arpa/inet.h>
+#include <pthread.h>
+#include <stdint.h>
+#ifdef __FreeBSD__
+	#include <sys/event.h>
+#else
+	#include <sys/epoll.h>
+#endif
 
 #include "../../pilight.h"
 #include "common.h"
 #include "log.h"
 #include "gc.h"
 #include "settings.h"
+#include "json.h"
+#include "msgpack.h"
 #include "socket.h"
 
-static char recvBuff[BUFFER_SIZE];
+/* Initial size of the client table, it grows up to MAX_CLIENTS */
+#define SOCKET_CLIENTS	32
+/* Events handled per wakeup of socket_wait */
+#define SOCKET_EVENTS	64
+
+/* Splits the stream of a connection into messages. The messages are
+   handed out in place, the buffer is only compacted once its end has
+   been reached and only grows for messages larger than it. Binary
+   connections are split on the length in front of every message. */
+typedef struct socket_framer_t {
+	int fd;
+	int binary;
+	char *buffer;
+	size_t size;
+	size_t start;
+	size_t scan;
+	size_t end;
+	struct socket_framer_t *next;
+} socket_framer_t;
+
+/* A frame waiting to be written to a client */
+typedef struct socket_output_t {
+	struct socket_frame_t *frame;
+	size_t offset;
+	time_t queued;
+	struct socket_output_t *next;
+} socket_output_t;
+
+/* The index in the client table is the id passed to the callbacks */
+typedef struct socket_client_t {
+	int fd;
+	struct socket_framer_t framer;
+	int dispatching;
+	struct socket_output_t *output;
+	struct socket_output_t *output_tail;
+	size_t outlen;
+	int evicted;
+} socket_client_t;
+
+typedef struct socket_event_t {
+	int fd;
+	int id;
+	int read;
+	int write;
+} socket_event_t;
+
 static unsigned short socket_loop = 1;
 static unsigned int socket_port = 0;
 static int socket_loopback = 0;
 static int socket_server = 0;
-static int socket_clients[MAX_CLIENTS];
+/* Listener for local clients on a unix domain socket */
+static int socket_local = 0;
+static char *socket_path = NULL;
+static int socket_poll = -1;
+static struct socket_client_t *socket_clients = NULL;
+static int socket_nrclients = 0;
+/* Framers of the connections we made ourselves */
+static struct socket_framer_t *socket_framers = NULL;
+static pthread_mutex_t socket_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void socket_framer_free(struct socket_framer_t *framer) {
+	if(framer->buffer) {
+		sfree((void *)&framer->buffer);
+	}
+	framer->size = 0;
+	framer->start = 0;
+	framer->scan = 0;
+	framer->end = 0;
+	framer->binary = 0;
+}
+
+/* Should be called with the socket_lock held */
+static struct socket_framer_t *socket_framer_find(int sockfd, int create) {
+	struct socket_framer_t *framer = socket_framers;
+
+	while(framer) {
+		if(framer->fd == sockfd) {
+			return framer;
+		}
+		framer = framer->next;
+	}
+	if(create == 1) {
+		if(!(framer = malloc(sizeof(struct socket_framer_t)))) {
+			logprintf(LOG_ERR, "out of memory");
+			exit(EXIT_FAILURE);
+		}
+		memset(framer, 0, sizeof(struct socket_framer_t));
+		framer->fd = sockfd;
+		framer->next = socket_framers;
+		socket_framers = framer;
+	}
+	return framer;
+}
+
+/* Where and how much can be received next, or NULL when
+   a message doesn't fit in MAX_FRAME_SIZE */
+static char *socket_framer_space(struct socket_framer_t *framer, size_t *avail) {
+	size_t size = 0;
+
+	if(framer->start == framer->end) {
+		framer->start = 0;
+		framer->scan = 0;
+		framer->end = 0;
+	}
+	if(framer->end == framer->size && framer->start > 0) {
+		memmove(framer->buffer, &framer->buffer[framer->start], framer->end-framer->start);
+		framer->scan -= framer->start;
+		framer->end -= framer->start;
+		framer->start = 0;
+	}
+	if(framer->end == framer->size) {
+		if(framer->size >= MAX_FRAME_SIZE) {
+			return NULL;
+		}
+		size = (framer->size == 0) ? BUFFER_SIZE : framer->size*2;
+		if(size > MAX_FRAME_SIZE) {
+			size = MAX_FRAME_SIZE;
+		}
+		/* Keep room for the terminating null */
+		if(!(framer->buffer = realloc(framer->buffer, size+1))) {
+			logprintf(LOG_ERR, "out of memory");
+			exit(EXIT_FAILURE);
+		}
+		framer->size = size;
+	}
+	*avail = framer->size-framer->end;
+	return &framer->buffer[framer->end];
+}
+
+/* Returns the next complete message, which stays valid until more is
+   received. Only clients are allowed to leave out the delimiter, like
+   simple scripts and browsers do. When drained is set they have nothing
+   more for us at the moment, so a remainder of whole lines, or ending
+   with a line holding a whole json object, is complete as well. */
+static char *socket_framer_next(struct socket_framer_t *framer, int drained) {
+	char *message = NULL, *p = NULL;
+	size_t len = strlen(EOSS), x = 0;
+
+	x = (framer->scan > framer->start) ? framer->scan : framer->start;
+	while(x+len <= framer->end) {
+		if((p = memchr(&framer->buffer[x], EOSS[0], framer->end-x)) == NULL) {
+			break;
+		}
+		x = (size_t)(p-framer->buffer);
+		if(x+len <= framer->end && memcmp(p, EOSS, len) == 0) {
+			*p = '\0';
+			message = &framer->buffer[framer->start];
+			framer->start = x+len;
+			framer->scan = framer->start;
+			return message;
+		}
+		x++;
+	}
+	/* A delimiter can be split over two reads */
+	framer->scan = (framer->end >= len) ? framer->end-(len-1) : 0;
+
+	if(drained == 0 || framer->end == framer->start) {
+		return NULL;
+	}
+	if(framer->buffer[framer->end-1] == '\n') {
+		framer->buffer[framer->end-1] = '\0';
+	} else if(framer->buffer[framer->end-1] == '}') {
+		/* A short read can stop at any brace of a larger object */
+		framer->buffer[framer->end] = '\0';
+		x = framer->end;
+		while(x > framer->start && framer->buffer[x-1] != '\n') {
+			x--;
+		}
+		if(json_validate(&framer->buffer[x]) == false) {
+			return NULL;
+		}
+	} else {
+		return NULL;
+	}
+	message = &framer->buffer[framer->start];
+	framer->start = framer->end;
+	framer->scan = framer->end;
+	return message;
+}
+
+/* Returns the next complete binary message, len is set to the
+   size of the MessagePack value without the length in front */
+static char *socket_framer_frame(struct socket_framer_t *framer, size_t *len) {
+	unsigned char *header = NULL;
+	size_t n = 0;
+
+	if(framer->end-framer->start < SOCKET_HEADER) {
+		return NULL;
+	}
+	header = (unsigned char *)&framer->buffer[framer->start];
+	n = ((size_t)header[0] << 24) | ((size_t)header[1] << 16) | ((size_t)header[2] << 8) | (size_t)header[3];
+	/* Larger messages fill the buffer until socket_framer_space gives up */
+	if(n > MAX_FRAME_SIZE || framer->end-framer->start-SOCKET_HEADER < n) {
+		return NULL;
+	}
+	*len = n;
+	framer->start += SOCKET_HEADER+n;
+	framer->scan = framer->start;
+	return (char *)&header[SOCKET_HEADER];
+}
 
 int socket_gc(void) {
 	int x = 0;
@@ -58,21 +263,283 @@ int socket_gc(void) {
        socket_read functions can actually close and the
 	   all threads using sockets can end gracefully */
 
-	for(x=1;x<MAX_CLIENTS;x++) {
-		if(socket_clients[x] > 0) {
-			send(socket_clients[x], "1", 1, MSG_NOSIGNAL);
+	pthread_mutex_lock(&socket_lock);
+	for(x=1;x<socket_nrclients;x++) {
+		if(socket_clients[x].fd > 0) {
+			send(socket_clients[x].fd, "1"EOSS, 1+strlen(EOSS), MSG_NOSIGNAL);
 		}
 	}
+	pthread_mutex_unlock(&socket_lock);
 
 	if(socket_loopback > 0) {
-		send(socket_loopback, "1", 1, MSG_NOSIGNAL);
+		send(socket_loopback, "1"EOSS, 1+strlen(EOSS), MSG_NOSIGNAL);
 		socket_close(socket_loopback);
 	}
 
+	if(socket_local > 0) {
+		close(socket_local);
+		socket_local = 0;
+	}
+	if(socket_path) {
+		unlink(socket_path);
+		sfree((void *)&socket_path);
+	}
+
 	logprintf(LOG_DEBUG, "garbage collected socket library");
 	return EXIT_SUCCESS;
 }
 
+/* Watch a socket for incoming data, edge triggered so a
+   wakeup only costs something for the sockets with data */
+static int socket_poll_add(int fd, int i, int output) {
+#ifdef __FreeBSD__
+	struct kevent events[2];
+
+	EV_SET(&events[0], fd, EVFILT_READ, EV_ADD | EV_CLEAR, 0, 0, (void *)(intptr_t)i);
+	EV_SET(&events[1], fd, EVFILT_WRITE, EV_ADD | EV_CLEAR, 0, 0, (void *)(intptr_t)i);
+	return kevent(socket_poll, events, (output == 1) ? 2 : 1, NULL, 0, NULL);
+#else
+	struct epoll_event event;
+
+	memset(&event, 0, sizeof(struct epoll_event));
+	event.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+	if(output == 1) {
+		event.events |= EPOLLOUT;
+	}
+	event.data.u64 = ((uint64_t)(unsigned int)fd << 32) | (uint32_t)i;
+	return epoll_ctl(socket_poll, EPOLL_CTL_ADD, fd, &event);
+#endif
+}
+
+static int socket_poll_wait(struct socket_event_t *events, int size) {
+	int n = 0, x = 0;
+#ifdef __FreeBSD__
+	struct kevent kevents[SOCKET_EVENTS];
+
+	if((n = kevent(socket_poll, NULL, 0, kevents, size, NULL)) > 0) {
+		for(x=0;x<n;x++) {
+			events[x].fd = (int)kevents[x].ident;
+			events[x].id = (int)(intptr_t)kevents[x].udata;
+			events[x].read = (kevents[x].filter == EVFILT_READ);
+			events[x].write = (kevents[x].filter == EVFILT_WRITE);
+		}
+	}
+#else
+	struct epoll_event eevents[SOCKET_EVENTS];
+
+	if((n = epoll_wait(socket_poll, eevents, size, -1)) > 0) {
+		for(x=0;x<n;x++) {
+			events[x].fd = (int)(eevents[x].data.u64 >> 32);
+			events[x].id = (int)(uint32_t)eevents[x].data.u64;
+			events[x].read = ((eevents[x].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) != 0);
+			events[x].write = ((eevents[x].events & EPOLLOUT) != 0);
+		}
+	}
+#endif
+	return n;
+}
+
+/* Returns the id of a free place in the client table for the socket,
+   or -1 when the maximum number of clients has been reached */
+static int socket_client_add(int fd) {
+	struct socket_client_t *clients = NULL;
+	int i = 0, size = 0;
+
+	pthread_mutex_lock(&socket_lock);
+	for(i=1;i<socket_nrclients;i++) {
+		if(socket_clients[i].fd == 0) {
+			break;
+		}
+	}
+	if(i == socket_nrclients) {
+		if(socket_nrclients >= MAX_CLIENTS) {
+			pthread_mutex_unlock(&socket_lock);
+			return -1;
+		}
+		size = socket_nrclients*2;
+		if(size > MAX_CLIENTS) {
+			size = MAX_CLIENTS;
+		}
+		if(!(clients = realloc(socket_clients, sizeof(struct socket_client_t)*(size_t)size))) {
+			logprintf(LOG_ERR, "out of memory");
+			exit(EXIT_FAILURE);
+		}
+		memset(&clients[socket_nrclients], 0, sizeof(struct socket_client_t)*(size_t)(size-socket_nrclients));
+		socket_clients = clients;
+		socket_nrclients = size;
+	}
+	memset(&socket_clients[i], 0, sizeof(struct socket_client_t));
+	socket_clients[i].fd = fd;
+	pthread_mutex_unlock(&socket_lock);
+	return i;
+}
+
+struct socket_frame_t *socket_frame_create(const char *msg) {
+	struct socket_frame_t *frame = NULL;
+	size_t n = strlen(msg), len = strlen(EOSS);
+
+	if(!(frame = malloc(sizeof(struct socket_frame_t)))) {
+		logprintf(LOG_ERR, "out of memory");
+		exit(EXIT_FAILURE);
+	}
+	if(!(frame->data = malloc(n+len+1))) {
+		logprintf(LOG_ERR, "out of memory");
+		exit(EXIT_FAILURE);
+	}
+	memcpy(frame->data, msg, n);
+	memcpy(&frame->data[n], EOSS, len+1);
+	frame->len = n+len;
+	frame->refs = 1;
+	return frame;
+}
+
+struct socket_frame_t *socket_frame_create_binary(JsonNode *json) {
+	struct socket_frame_t *frame = NULL;
+	size_t n = 0;
+
+	if(!(frame = malloc(sizeof(struct socket_frame_t)))) {
+		logprintf(LOG_ERR, "out of memory");
+		exit(EXIT_FAILURE);
+	}
+	frame->data = msgpack_encode(json, SOCKET_HEADER, &frame->len);
+	n = frame->len-SOCKET_HEADER;
+	frame->data[0] = (char)((n >> 24) & 0xff);
+	frame->data[1] = (char)((n >> 16) & 0xff);
+	frame->data[2] = (char)((n >> 8) & 0xff);
+	frame->data[3] = (char)(n & 0xff);
+	frame->refs = 1;
+	return frame;
+}
+
+/* Messages that aren't json, like the heartbeats, are sent as a string */
+static struct socket_frame_t *socket_frame_transcode(const char *msg) {
+	struct socket_frame_t *frame = NULL;
+	JsonNode *json = NULL;
+
+	if((json = json_decode(msg)) == NULL) {
+		json = json_mkstring(msg);
+	}
+	frame = socket_frame_create_binary(json);
+	json_delete(json);
+	return frame;
+}
+
+void socket_frame_free(struct socket_frame_t *frame) {
+	if(__sync_sub_and_fetch(&frame->refs, 1) == 0) {
+		sfree((void *)&frame->data);
+		sfree((void *)&frame);
+	}
+}
+
+/* Should be called with the socket_lock held */
+static void socket_output_clear(struct socket_client_t *client) {
+	struct socket_output_t *tmp = NULL;
+
+	while(client->output) {
+		tmp = client->output;
+		client->output = client->output->next;
+		socket_frame_free(tmp->frame);
+		sfree((void *)&tmp);
+	}
+	client->output_tail = NULL;
+	client->outlen = 0;
+}
+
+/* Should be called with the socket_lock held. Write as much of the
+   queued output as the socket takes without blocking. */
+static void socket_output_flush(struct socket_client_t *client) {
+	struct socket_output_t *tmp = NULL;
+	ssize_t bytes = 0;
+
+	while(client->output) {
+		tmp = client->output;
+		bytes = send(client->fd, &tmp->frame->data[tmp->offset], tmp->frame->len-tmp->offset, MSG_NOSIGNAL | MSG_DONTWAIT);
+		if(bytes > 0) {
+			tmp->offset += (size_t)bytes;
+			client->outlen -= (size_t)bytes;
+			if(tmp->offset == tmp->frame->len) {
+				client->output = tmp->next;
+				if(client->output == NULL) {
+					client->output_tail = NULL;
+				}
+				socket_frame_free(tmp->frame);
+				sfree((void *)&tmp);
+			}
+		} else if(bytes == -1 && errno == EINTR) {
+			continue;
+		} else {
+			if(bytes == -1 && errno != EAGAIN && errno != EWOULDBLOCK) {
+				/* The connection is gone, socket_wait cleans it up */
+				socket_output_clear(client);
+			}
+			break;
+		}
+	}
+}
+
+/* Should be called with the socket_lock held. A client that can't keep
+   up with what we send is disconnected, so it won't hold back others. */
+static int socket_output_queue(struct socket_client_t *client, struct socket_frame_t *frame) {
+	struct socket_output_t *node = NULL;
+
+	if(client->evicted == 1) {
+		return -1;
+	}
+	if(!(node = malloc(sizeof(struct socket_output_t)))) {
+		logprintf(LOG_ERR, "out of memory");
+		exit(EXIT_FAILURE);
+	}
+	__sync_add_and_fetch(&frame->refs, 1);
+	node->frame = frame;
+	node->offset = 0;
+	node->queued = time(NULL);
+	node->next = NULL;
+	if(client->output_tail) {
+		client->output_tail->next = node;
+	} else {
+		client->output = node;
+	}
+	client->output_tail = node;
+	client->outlen += frame->len;
+
+	socket_output_flush(client);
+
+	if(client->outlen > MAX_CLIENT_OUTPUT ||
+	   (client->output && (time(NULL)-client->output->queued) > MAX_CLIENT_DELAY)) {
+		logprintf(LOG_NOTICE, "client fd: %d too slow, %lu bytes waiting, disconnecting", client->fd, (unsigned long)client->outlen);
+		socket_output_clear(client);
+		client->evicted = 1;
+		/* Let socket_wait see the hangup and clean up the client */
+		shutdown(client->fd, 2);
+		return -1;
+	}
+	return 0;
+}
+
+int socket_write_frame(int i, struct socket_frame_t *frame) {
+	int ret = -1;
+
+	pthread_mutex_lock(&socket_lock);
+	if(i > 0 && i < socket_nrclients && socket_clients[i].fd > 0) {
+		ret = socket_output_queue(&socket_clients[i], frame);
+	}
+	pthread_mutex_unlock(&socket_lock);
+	return ret;
+}
+
+/* Should be called with the socket_lock held */
+static void socket_client_clear(struct socket_client_t *client) {
+	/* Hand over what can still be written without waiting */
+	socket_output_flush(client);
+	socket_output_clear(client);
+	client->fd = 0;
+	/* The messages being handed out by socket_wait point into it */
+	if(client->dispatching == 0) {
+		socket_framer_free(&client->framer);
+	}
+	client->evicted = 0;
+}
+
 /* Start the socket server */
 int socket_start(unsigned short port) {
 	//gc_attach(socket_gc);
@@ -82,7 +549,15 @@ int socket_start(unsigned short port) {
 	int opt = 1;
 
 	memset(&address, '\0', sizeof(struct sockaddr_in));
-	memset(socket_clients, 0, sizeof(socket_clients));
+
+	pthread_mutex_lock(&socket_lock);
+	if(!(socket_clients = malloc(sizeof(struct socket_client_t)*SOCKET_CLIENTS))) {
+		logprintf(LOG_ERR, "out of memory");
+		exit(EXIT_FAILURE);
+	}
+	memset(socket_clients, 0, sizeof(struct socket_client_t)*SOCKET_CLIENTS);
+	socket_nrclients = SOCKET_CLIENTS;
+	pthread_mutex_unlock(&socket_lock);
 
     //create a master socket
     if((socket_server = socket(AF_INET , SOCK_STREAM , 0)) == 0)  {
@@ -111,12 +586,31 @@ int socket_start(unsigned short port) {
         exit(EXIT_FAILURE);
     }
 
-    //try to specify maximum of 3 pending connections for the master socket
-    if(listen(socket_server, 3) < 0) {
+    //let the kernel queue as many pending connections as it allows
+    if(listen(socket_server, SOMAXCONN) < 0) {
         logprintf(LOG_ERR, "failed to listen to socket");
         exit(EXIT_FAILURE);
     }
 
+	/* All pending connections are accepted at once */
+	int flags = fcntl(socket_server, F_GETFL, 0);
+	if(flags != -1) {
+		fcntl(socket_server, F_SETFL, flags | O_NONBLOCK);
+	}
+
+#ifdef __FreeBSD__
+	if((socket_poll = kqueue()) < 0) {
+#else
+	if((socket_poll = epoll_create(SOCKET_EVENTS)) < 0) {
+#endif
+		logprintf(LOG_ERR, "could not create socket event queue");
+		exit(EXIT_FAILURE);
+	}
+	if(socket_poll_add(socket_server, -1, 0) < 0) {
+		logprintf(LOG_ERR, "could not watch the socket");
+		exit(EXIT_FAILURE);
+	}
+
 	static struct linger linger = { 0, 0 };
 	socklen_t lsize = sizeof(struct linger);
 	setsockopt(socket_server, SOL_SOCKET, SO_LINGER, (void *)&linger, lsize);
@@ -130,12 +624,109 @@ int socket_start(unsigned short port) {
 	   or else the select statement will wait forever for an activity */
 	char localhost[16] = "127.0.0.1";
 	socket_loopback = socket_connect(localhost, (unsigned short)socket_port);
-	socket_clients[0] = socket_loopback;
+	pthread_mutex_lock(&socket_lock);
+	socket_clients[0].fd = socket_loopback;
+	pthread_mutex_unlock(&socket_lock);
 	logprintf(LOG_INFO, "daemon listening to port: %d", socket_port);
 
     return 0;
 }
 
+/* Let local clients connect through a unix domain socket as well,
+   they are handled exactly like the clients connecting over tcp */
+/* Only a socket nobody listens to anymore may be removed */
+static int socket_local_stale(struct sockaddr_un *address) {
+	struct stat st;
+	int fd = 0, ret = 0;
+
+	if(lstat(address->sun_path, &st) != 0) {
+		return 0;
+	}
+	if(!S_ISSOCK(st.st_mode)) {
+		logprintf(LOG_ERR, "socket file %s exists but is not a socket", address->sun_path);
+		return -1;
+	}
+	if((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		return -1;
+	}
+	if(connect(fd, (struct sockaddr *)address, sizeof(struct sockaddr_un)) == 0) {
+		logprintf(LOG_ERR, "socket file %s is in use by another process", address->sun_path);
+		ret = -1;
+	} else if(errno != ECONNREFUSED) {
+		logprintf(LOG_ERR, "could not check socket file %s", address->sun_path);
+		ret = -1;
+	} else {
+		unlink(address->sun_path);
+	}
+	close(fd);
+	return ret;
+}
+
+int socket_start_local(const char *path) {
+	struct sockaddr_un address;
+
+	if(strlen(path) >= sizeof(address.sun_path)) {
+		logprintf(LOG_NOTICE, "socket file path too long: %s", path);
+		return -1;
+	}
+
+	memset(&address, '\0', sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, path);
+
+	if((socket_local = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		logprintf(LOG_NOTICE, "could not create local socket");
+		socket_local = 0;
+		return -1;
+	}
+
+	/* Remove the socket file left behind by a previous run */
+	if(socket_local_stale(&address) != 0) {
+		close(socket_local);
+		socket_local = 0;
+		return -1;
+	}
+	if(bind(socket_local, (struct sockaddr *)&address, sizeof(address)) < 0) {
+		logprintf(LOG_NOTICE, "could not bind local socket: %s", path);
+		close(socket_local);
+		socket_local = 0;
+		return -1;
+	}
+	if(listen(socket_local, SOMAXCONN) < 0) {
+		logprintf(LOG_NOTICE, "could not listen to local socket: %s", path);
+		close(socket_local);
+		socket_local = 0;
+		unlink(path);
+		return -1;
+	}
+
+	int flags = fcntl(socket_local, F_GETFL, 0);
+	if(flags != -1) {
+		fcntl(socket_local, F_SETFL, flags | O_NONBLOCK);
+	}
+
+	if(socket_poll_add(socket_local, -2, 0) < 0) {
+		logprintf(LOG_NOTICE, "could not watch local socket: %s", path);
+		close(socket_local);
+		socket_local = 0;
+		unlink(path);
+		return -1;
+	}
+
+	if(!(socket_path = malloc(strlen(path)+1))) {
+		logprintf(LOG_ERR, "out of memory");
+		exit(EXIT_FAILURE);
+	}
+	strcpy(socket_path, path);
+
+	logprintf(LOG_INFO, "daemon listening to socket: %s", socket_path);
+	return 0;
+}
+
+char *socket_get_path(void) {
+	return socket_path;
+}
+
 unsigned int socket_get_port(void) {
 	return socket_port;
 }
@@ -145,17 +736,68 @@ int socket_get_fd(void) {
 }
 
 int socket_get_clients(int i) {
-	return socket_clients[i];
+	int fd = 0;
+
+	pthread_mutex_lock(&socket_lock);
+	if(i >= 0 && i < socket_nrclients) {
+		fd = socket_clients[i].fd;
+	}
+	pthread_mutex_unlock(&socket_lock);
+	return fd;
+}
+
+/* Switch a connection to binary messages in both directions */
+void socket_set_binary(int sockfd) {
+	struct socket_framer_t *framer = NULL;
+	int i = 0;
+
+	pthread_mutex_lock(&socket_lock);
+	for(i=1;i<socket_nrclients;i++) {
+		if(socket_clients[i].fd == sockfd) {
+			framer = &socket_clients[i].framer;
+			break;
+		}
+	}
+	if(!framer) {
+		framer = socket_framer_find(sockfd, 1);
+	}
+	framer->binary = 1;
+	framer->scan = framer->start;
+	pthread_mutex_unlock(&socket_lock);
+}
+
+int socket_get_binary(int i) {
+	int binary = 0;
+
+	pthread_mutex_lock(&socket_lock);
+	if(i > 0 && i < socket_nrclients && socket_clients[i].fd > 0) {
+		binary = socket_clients[i].framer.binary;
+	}
+	pthread_mutex_unlock(&socket_lock);
+	return binary;
 }
 
+/* An address starting with a slash is the path of a unix
+   domain socket, the port is ignored in that case */
 int socket_connect(char *address, unsigned short port) {
-	struct sockaddr_in serv_addr;
-	int sockfd;
+	struct sockaddr_storage serv_addr;
+	struct sockaddr_in *inet_addr = (struct sockaddr_in *)&serv_addr;
+	struct sockaddr_un *unix_addr = (struct sockaddr_un *)&serv_addr;
+	socklen_t addrlen = sizeof(struct sockaddr_in);
+	int sockfd, family = AF_INET;
 	fd_set fdset;
 	struct timeval tv;
 
+	if(address[0] == '/') {
+		if(strlen(address) >= sizeof(unix_addr->sun_path)) {
+			return -1;
+		}
+		family = AF_UNIX;
+		addrlen = sizeof(struct sockaddr_un);
+	}
+
 	/* Try to open a new socket */
-    if((sockfd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+    if((sockfd = socket(family, SOCK_STREAM, 0)) < 0) {
         logprintf(LOG_ERR, "could not create socket");
 		return -1;
     }
@@ -163,9 +805,14 @@ int socket_connect(char *address, unsigned short port) {
 	/* Clear the server address */
     memset(&serv_addr, '\0', sizeof(serv_addr));
 
-    serv_addr.sin_family = AF_INET;
-    serv_addr.sin_port = htons(port);
-    inet_pton(AF_INET, address, &serv_addr.sin_addr);
+	if(family == AF_UNIX) {
+		unix_addr->sun_family = AF_UNIX;
+		strcpy(unix_addr->sun_path, address);
+	} else {
+		inet_addr->sin_family = AF_INET;
+		inet_addr->sin_port = htons(port);
+		inet_pton(AF_INET, address, &inet_addr->sin_addr);
+	}
 
 	fcntl(sockfd, F_SETFL, O_NONBLOCK);
 
@@ -175,7 +822,11 @@ int socket_connect(char *address, unsigned short port) {
     tv.tv_usec = 0;
 
 	/* Connect to the server */
-	connect(sockfd, (struct sockaddr *)&serv_addr, sizeof(serv_addr));
+	if(connect(sockfd, (struct sockaddr *)&serv_addr, addrlen) < 0 && family == AF_UNIX && errno != EAGAIN && errno != EINPROGRESS) {
+		/* Nobody is listening to the socket file */
+		close(sockfd);
+		return -1;
+	}
 
 	if(select(sockfd+1, NULL, &fdset, NULL, &tv) == 1) {
         int error = -1;
@@ -200,25 +851,104 @@ void socket_close(int sockfd) {
 	int addrlen = sizeof(address);
 
 	if(sockfd > 0) {
-		if(getpeername(sockfd, (struct sockaddr*)&address, (socklen_t*)&addrlen) == 0) {
+		if(getpeername(sockfd, (struct sockaddr*)&address, (socklen_t*)&addrlen) == 0 && address.sin_family == AF_INET) {
 			logprintf(LOG_DEBUG, "client disconnected, ip %s, port %d", inet_ntoa(address.sin_addr), ntohs(address.sin_port));
 		}
 
-		for(i=0;i<MAX_CLIENTS;i++) {
-			if(socket_clients[i] == sockfd) {
-				socket_clients[i] = 0;
+		pthread_mutex_lock(&socket_lock);
+		for(i=0;i<socket_nrclients;i++) {
+			if(socket_clients[i].fd == sockfd) {
+				socket_client_clear(&socket_clients[i]);
 				break;
 			}
 		}
+		struct socket_framer_t *framer = socket_framers, *prev = NULL;
+		while(framer) {
+			if(framer->fd == sockfd) {
+				if(prev) {
+					prev->next = framer->next;
+				} else {
+					socket_framers = framer->next;
+				}
+				socket_framer_free(framer);
+				sfree((void *)&framer);
+				break;
+			}
+			prev = framer;
+			framer = framer->next;
+		}
+		pthread_mutex_unlock(&socket_lock);
 		shutdown(sockfd, 2);
 		close(sockfd);
 	}
 }
 
+/* Should be called with the socket_lock held */
+static int socket_is_binary(int sockfd) {
+	struct socket_framer_t *framer = NULL;
+	int i = 0;
+
+	for(i=1;i<socket_nrclients;i++) {
+		if(socket_clients[i].fd == sockfd) {
+			return socket_clients[i].framer.binary;
+		}
+	}
+	if((framer = socket_framer_find(sockfd, 0)) != NULL) {
+		return framer->binary;
+	}
+	return 0;
+}
+
+/* Queue a frame for one of our own clients or write it to a connection
+   we made ourselves. The text is what gets logged, if anything. */
+static int socket_send(int sockfd, struct socket_frame_t *frame, const char *text, int textlen) {
+	size_t ptr = 0, x = 0;
+	int bytes = -1, i = 0;
+
+	/* Our own clients get it in order with what has been queued */
+	pthread_mutex_lock(&socket_lock);
+	for(i=1;i<socket_nrclients;i++) {
+		if(socket_clients[i].fd == sockfd) {
+			break;
+		}
+	}
+	if(i < socket_nrclients) {
+		if(socket_output_queue(&socket_clients[i], frame) == 0) {
+			bytes = (int)frame->len;
+		}
+		pthread_mutex_unlock(&socket_lock);
+		if(bytes > 0 && text && strncmp(text, "BEAT", 4) != 0) {
+			logprintf(LOG_DEBUG, "socket write queued: %.*s", textlen, text);
+		}
+		return bytes;
+	}
+	pthread_mutex_unlock(&socket_lock);
+
+	while(ptr < frame->len) {
+		if((frame->len-ptr) < BUFFER_SIZE) {
+			x = (frame->len-ptr);
+		} else {
+			x = BUFFER_SIZE;
+		}
+		if((bytes = (int)send(sockfd, &frame->data[ptr], x, MSG_NOSIGNAL)) == -1) {
+			if(text) {
+				logprintf(LOG_DEBUG, "socket write failed: %.*s", textlen, text);
+			}
+			return -1;
+		}
+		ptr += (size_t)bytes;
+	}
+
+	if(text && strncmp(text, "BEAT", 4) != 0) {
+		logprintf(LOG_DEBUG, "socket write succeeded: %.*s", textlen, text);
+	}
+	return (int)frame->len;
+}
+
 int socket_write(int sockfd, const char *msg, ...) {
+	struct socket_frame_t *frame = NULL;
 	va_list ap;
-	int bytes = -1;
-	int ptr = 0, n = 0, x = BUFFER_SIZE, len = (int)strlen(EOSS);
+	int n = 0, len = (int)strlen(EOSS), binary = 0;
 	char *sendBuff = NULL;
 	if(strlen(msg) > 0 && sockfd > 0) {
 
@@ -236,61 +966,119 @@ int socket_write(int sockfd, const char *msg, ...) {
 		vsprintf(sendBuff, msg, ap);
 		va_end(ap);
 
-		memcpy(&sendBuff[n-len], EOSS, (size_t)len);
+		/* Connections that switched to binary get it as MessagePack */
+		pthread_mutex_lock(&socket_lock);
+		binary = socket_is_binary(sockfd);
+		pthread_mutex_unlock(&socket_lock);
 
-		while(ptr < n) {
-			if((n-ptr) < BUFFER_SIZE) {
-				x = (n-ptr);
-			} else {
-				x = BUFFER_SIZE;
-			}
-			if((bytes = (int)send(sockfd, &sendBuff[ptr], (size_t)x, MSG_NOSIGNAL)) == -1) {
-				/* Change the delimiter into regular newlines */
-				sendBuff[n-(len-1)] = '\0';
-				sendBuff[n-(len)] = '\n';
-				logprintf(LOG_DEBUG, "socket write failed: %s", sendBuff);
-				sfree((void *)&sendBuff);
-				return -1;
+		if(binary == 1) {
+			frame = socket_frame_transcode(sendBuff);
+			n = socket_send(sockfd, frame, sendBuff, n-len);
+			sfree((void *)&sendBuff);
+		} else {
+			memcpy(&sendBuff[n-len], EOSS, (size_t)len);
+			if(!(frame = malloc(sizeof(struct socket_frame_t)))) {
+				logprintf(LOG_ERR, "out of memory");
+				exit(EXIT_FAILURE);
 			}
-			ptr += bytes;
+			frame->data = sendBuff;
+			frame->len = (size_t)n;
+			frame->refs = 1;
+			n = socket_send(sockfd, frame, sendBuff, n-len);
 		}
+		socket_frame_free(frame);
+	}
+	return n;
+}
 
-		if(strncmp(&sendBuff[0], "BEAT", 4) != 0) {
-			/* Change the delimiter into regular newlines */
-			sendBuff[n-(len-1)] = '\0';
-			sendBuff[n-(len)] = '\n';
-			logprintf(LOG_DEBUG, "socket write succeeded: %s", sendBuff);
-		}
-		sfree((void *)&sendBuff);
+int socket_write_json(int sockfd, JsonNode *json) {
+	struct socket_frame_t *frame = NULL;
+	char *msg = NULL;
+	int n = -1, binary = 0;
+
+	pthread_mutex_lock(&socket_lock);
+	binary = socket_is_binary(sockfd);
+	pthread_mutex_unlock(&socket_lock);
+
+	if(binary == 1) {
+		frame = socket_frame_create_binary(json);
+		n = socket_send(sockfd, frame, NULL, 0);
+		socket_frame_free(frame);
+	} else {
+		msg = json_stringify(json, NULL);
+		n = socket_write(sockfd, "%s", msg);
+		sfree((void *)&msg);
 	}
 	return n;
 }
 
-void socket_rm_client(int i, struct socket_callback_t *socket_callback) {
+static void socket_rm_client(int i, int sd, struct socket_callback_t *socket_callback) {
     struct sockaddr_in address;
 	int addrlen = sizeof(address);
-	int sd = socket_clients[i];
 
 	//Somebody disconnected, get his details and print
-	getpeername(sd, (struct sockaddr*)&address, (socklen_t*)&addrlen);
-	logprintf(LOG_DEBUG, "client disconnected, ip %s, port %d", inet_ntoa(address.sin_addr), ntohs(address.sin_port));
+	if(getpeername(sd, (struct sockaddr*)&address, (socklen_t*)&addrlen) == 0 && address.sin_family == AF_INET) {
+		logprintf(LOG_DEBUG, "client disconnected, ip %s, port %d", inet_ntoa(address.sin_addr), ntohs(address.sin_port));
+	} else {
+		logprintf(LOG_DEBUG, "client disconnected, local socket");
+	}
 	if(socket_callback->client_disconnected_callback)
 		socket_callback->client_disconnected_callback(i);
 	//Close the socket and mark as 0 in list for reuse
 	shutdown(sd, 2);
 	close(sd);
-	socket_clients[i] = 0;
+	pthread_mutex_lock(&socket_lock);
+	if(i < socket_nrclients && socket_clients[i].fd == sd) {
+		socket_client_clear(&socket_clients[i]);
+	}
+	pthread_mutex_unlock(&socket_lock);
 }
 
+/* Returns the next message received on a connection we made, messages
+   that arrived together are handed out one at a time */
 char *socket_read(int sockfd) {
-	int bytes = 0;
-	size_t msglen = 0;
-	int ptr = 0, n = 0, len = (int)strlen(EOSS);
+	struct socket_framer_t *framer = NULL;
+	int bytes = 0, n = 0;
+	size_t avail = 0, len = 0;
 	fd_set fdsread;
-	char *message = NULL;
+	char *message = NULL, *space = NULL;
+	JsonNode *json = NULL;
 	fcntl(sockfd, F_SETFL, O_NONBLOCK);
 
+	pthread_mutex_lock(&socket_lock);
+	framer = socket_framer_find(sockfd, 1);
+	pthread_mutex_unlock(&socket_lock);
+
 	while(socket_loop) {
+		/* Binary messages are handed out as json as well */
+		if(framer->binary == 1 && (message = socket_framer_frame(framer, &len)) != NULL) {
+			if((json = msgpack_decode(message, len)) == NULL) {
+				logprintf(LOG_NOTICE, "socket received an invalid binary message");
+				return NULL;
+			}
+			if(json->tag == JSON_STRING) {
+				if(strcmp(json->string_, "1") == 0 || strcmp(json->string_, "BEAT") == 0) {
+					json_delete(json);
+					return NULL;
+				}
+				message = strdup(json->string_);
+			} else {
+				message = json_stringify(json, NULL);
+			}
+			json_delete(json);
+			return message;
+		}
+		/* The daemon always delimits its messages */
+		if(framer->binary == 0 && (message = socket_framer_next(framer, 0)) != NULL) {
+			if(strcmp(message, "1") == 0 || strcmp(message, "BEAT") == 0) {
+				return NULL;
+			}
+			if(strlen(message) == 0) {
+				continue;
+			}
+			return strdup(message);
+		}
+
 		FD_ZERO(&fdsread);
 		FD_SET((unsigned long)sockfd, &fdsread);
 
@@ -304,173 +1092,241 @@ char *socket_read(int sockfd) {
 		}
 		if(n == -1) {
 			return NULL;
-		} else if(n > 0) {
-			if(FD_ISSET((unsigned long)sockfd, &fdsread)) {
-				bytes = (int)recv(sockfd, recvBuff, BUFFER_SIZE, 0);
+		} else if(n > 0 && FD_ISSET((unsigned long)sockfd, &fdsread)) {
+			if((space = socket_framer_space(framer, &avail)) == NULL) {
+				logprintf(LOG_ERR, "socket message larger than %d bytes", MAX_FRAME_SIZE);
+				return NULL;
+			}
+			if((bytes = (int)recv(sockfd, space, avail, 0)) <= 0) {
+				return NULL;
+			}
+			framer->end += (size_t)bytes;
+		}
+	}
 
-				if(bytes <= 0) {
-					return NULL;
-				} else {
-					ptr+=bytes;
-					if((message = realloc(message, (size_t)ptr+1)) == NULL) {
-						logprintf(LOG_ERR, "out of memory");
-						exit(EXIT_FAILURE);
-					}
-					memset(&message[(ptr-bytes)], '\0', (size_t)bytes+1);
-					memcpy(&message[(ptr-bytes)], recvBuff, (size_t)bytes);
-					msglen = strlen(message);
+	return NULL;
+}
+
+static void socket_accept(int server, struct socket_callback_t *socket_callback) {
+    struct sockaddr_storage storage;
+	struct sockaddr_in *address = (struct sockaddr_in *)&storage;
+	char peer[INET_ADDRSTRLEN+16], localhost[16] = "127.0.0.1";
+	int socket_client = 0, i = 0;
+	socklen_t addrlen = 0;
+
+	while(socket_loop) {
+		addrlen = sizeof(storage);
+		if((socket_client = accept(server, (struct sockaddr *)&storage, &addrlen)) < 0) {
+			if(errno == EINTR || errno == ECONNABORTED) {
+				continue;
+			}
+			if(errno != EAGAIN && errno != EWOULDBLOCK) {
+				logprintf(LOG_ERR, "failed to accept client");
+			}
+			break;
+		}
+		/* Local clients are treated as if they connected from localhost */
+		if(storage.ss_family == AF_INET) {
+			snprintf(peer, sizeof(peer), "ip: %s, port: %d", inet_ntoa(address->sin_addr), ntohs(address->sin_port));
+		} else {
+			strcpy(peer, "local socket");
+		}
+		if(whitelist_check(storage.ss_family == AF_INET ? inet_ntoa(address->sin_addr) : localhost) != 0) {
+			logprintf(LOG_INFO, "rejected client, %s", peer);
+			shutdown(socket_client, 2);
+			close(socket_client);
+			continue;
+		}
+		if((i = socket_client_add(socket_client)) == -1) {
+			logprintf(LOG_NOTICE, "rejected client, %s, too many clients", peer);
+			shutdown(socket_client, 2);
+			close(socket_client);
+			continue;
+		}
+		//inform user of socket number - used in send and receive commands
+		logprintf(LOG_INFO, "new client, %s", peer);
+		logprintf(LOG_DEBUG, "client fd: %d", socket_client);
+
+		static struct linger linger = { 0, 0 };
+		socklen_t lsize = sizeof(struct linger);
+		setsockopt(socket_client, SOL_SOCKET, SO_LINGER, (void *)&linger, lsize);
+		int flags = fcntl(socket_client, F_GETFL, 0);
+		if(flags != -1) {
+			fcntl(socket_client, F_SETFL, flags | O_NONBLOCK);
+		}
+
+		if(socket_poll_add(socket_client, i, 1) < 0) {
+			logprintf(LOG_ERR, "could not watch client fd: %d", socket_client);
+			socket_close(socket_client);
+			continue;
+		}
+		if(socket_callback->client_connected_callback)
+			socket_callback->client_connected_callback(i);
+		logprintf(LOG_DEBUG, "client id: %d", i);
+	}
+}
+
+/* Hand out a binary message of a client, objects and arrays go to the
+   json callback when there is one so they don't have to be parsed
+   again. Returns -1 when the message is invalid. */
+static int socket_client_binary(int i, char *message, size_t len, struct socket_callback_t *socket_callback) {
+	JsonNode *json = NULL;
+	char *text = NULL;
+
+	if((json = msgpack_decode(message, len)) == NULL) {
+		return -1;
+	}
+	if(json->tag == JSON_STRING) {
+		if(socket_callback->client_data_callback) {
+			socket_callback->client_data_callback(i, json->string_);
+		}
+	} else if(socket_callback->client_json_callback) {
+		socket_callback->client_json_callback(i, json);
+	} else if(socket_callback->client_data_callback) {
+		text = json_stringify(json, NULL);
+		socket_callback->client_data_callback(i, text);
+		sfree((void *)&text);
+	}
+	json_delete(json);
+	return 0;
+}
+
+/* Read and hand out everything a client has sent, as the socket is
+   edge triggered we only hear of it again when new data arrives.
+   Returns -1 when the connection is gone. */
+static int socket_client_read(int i, int sd, struct socket_callback_t *socket_callback) {
+	struct socket_client_t *client = NULL;
+	char *space = NULL, *message = NULL, *pch = NULL, *saveptr = NULL;
+	size_t avail = 0, len = 0;
+	int bytes = 0, drained = 0, ret = 0, binary = 0;
+
+	pthread_mutex_lock(&socket_lock);
+	if(i >= socket_nrclients || socket_clients[i].fd != sd) {
+		pthread_mutex_unlock(&socket_lock);
+		return 0;
+	}
+	client = &socket_clients[i];
+	client->dispatching = 1;
+
+	while(socket_loop && ret == 0 && drained == 0 && client->fd == sd) {
+		if((space = socket_framer_space(&client->framer, &avail)) == NULL) {
+			logprintf(LOG_NOTICE, "client fd: %d sent a message larger than %d bytes, disconnecting", sd, MAX_FRAME_SIZE);
+			ret = -1;
+			break;
+		}
+		if((bytes = (int)recv(sd, space, avail, 0)) > 0) {
+			client->framer.end += (size_t)bytes;
+		} else if(bytes == 0) {
+			ret = -1;
+			drained = 1;
+		} else if(errno == EAGAIN || errno == EWOULDBLOCK) {
+			drained = 1;
+		} else if(errno != EINTR) {
+			ret = -1;
+			drained = 1;
+		}
+
+		/* Messages point into the framer, which socket_close
+		   leaves alone while we are handing them out. A client
+		   can switch to binary halfway through what it has sent. */
+		while(client->fd == sd) {
+			if((binary = client->framer.binary) == 1) {
+				message = socket_framer_frame(&client->framer, &len);
+			} else {
+				message = socket_framer_next(&client->framer, drained);
+			}
+			if(message == NULL) {
+				break;
+			}
+			if(binary == 0 && (strcmp(message, "1") == 0 || strcmp(message, "BEAT") == 0)) {
+				ret = -1;
+				break;
+			}
+			pthread_mutex_unlock(&socket_lock);
+			if(binary == 1) {
+				if(socket_client_binary(i, message, len, socket_callback) != 0) {
+					logprintf(LOG_NOTICE, "client fd: %d sent an invalid binary message, disconnecting", sd);
+					ret = -1;
 				}
-				if(message && msglen > 0) {
-					/* When a stream is larger then the buffer size, it has to contain
-					   the pilight delimiter to know when the stream ends. If the stream
-					   is shorter then the buffer size, we know we received the full stream */
-					int l = 0;
-					if(((l = strncmp(&message[ptr-(len)], EOSS, (unsigned int)(len))) == 0) || ptr < BUFFER_SIZE) {
-						/* If the socket contains buffered TCP messages, separate them by
-						   changing the delimiters into newlines */
-						if(ptr > msglen) {
-							int i = 0;
-							for(i=0;i<ptr;i++) {
-								if(i+(len-1) < ptr && strncmp(&message[i], EOSS, (size_t)len) == 0) {
-									memmove(&message[i], &message[i+(len-1)], (size_t)(ptr-(i+(len-1))));
-									ptr-=(len-1);
-									message[i] = '\n';
-								}
-							}
-							message[ptr] = '\0';
-						} else {
-							if(l == 0) {
-								message[ptr-(len)] = '\0'; // remove delimiter
-							} else {
-								message[ptr] = '\0';
-							}
-							if(strcmp(message, "1") == 0 || strcmp(message, "BEAT") == 0) {
-								sfree((void *)&message);
-								return NULL;
-							}
-						}
-						return message;
-					}
+			} else if(socket_callback->client_data_callback) {
+				pch = strtok_r(message, "\n", &saveptr);
+				while(pch != NULL) {
+					socket_callback->client_data_callback(i, pch);
+					pch = strtok_r(NULL, "\n", &saveptr);
 				}
 			}
+			pthread_mutex_lock(&socket_lock);
+			/* The table could have grown in the meantime */
+			client = &socket_clients[i];
+			if(ret == -1) {
+				break;
+			}
 		}
 	}
 
-	return NULL;
+	client->dispatching = 0;
+	if(client->fd != sd) {
+		socket_framer_free(&client->framer);
+	}
+	pthread_mutex_unlock(&socket_lock);
+	return ret;
 }
 
 void *socket_wait(void *param) {
 	struct socket_callback_t *socket_callback = (struct socket_callback_t *)param;
-
-	int activity;
-	int i, sd;
-    int max_sd;
-    struct sockaddr_in address;
-	int socket_client;
-	int addrlen = sizeof(address);
-	fd_set readfds;
+	struct socket_event_t events[SOCKET_EVENTS];
+	int n = 0, x = 0, i = 0, sd = 0;
 
 	while(socket_loop) {
 		do {
-			//clear the socket set
-			FD_ZERO(&readfds);
-
-			//add master socket to set
-			FD_SET((unsigned long)socket_get_fd(), &readfds);
-			max_sd = socket_get_fd();
-
-			//add child sockets to set
-			for(i=0;i<MAX_CLIENTS;i++) {
-				//socket descriptor
-				sd = socket_clients[i];
-				//if valid socket descriptor then add to read list
-				if(sd > 0)
-					FD_SET((unsigned long)sd, &readfds);
-
-				//highest file descriptor number, need it for the select function
-				if(sd > max_sd)
-					max_sd = sd;
-			}
-			//wait for an activity on one of the sockets, timeout is NULL, so wait indefinitely
-			activity = select(max_sd + 1, &readfds, NULL, NULL, NULL);
-		} while(activity == -1 && errno == EINTR && socket_loop);
+			n = socket_poll_wait(events, SOCKET_EVENTS);
+		} while(n == -1 && errno == EINTR && socket_loop);
 
-		/* Immediatly stop loop if the select was waken up by the garbage collector */
-		if(socket_loop == 0) {
+		/* Immediatly stop loop if the wait was waken up by the garbage collector */
+		if(socket_loop == 0 || n == -1) {
 			break;
 		}
 
-        //If something happened on the master socket, then its an incoming connection
-        if(FD_ISSET((unsigned long)socket_get_fd(), &readfds)) {
-            if((socket_client = accept(socket_get_fd(), (struct sockaddr *)&address, (socklen_t*)&addrlen))<0) {
-                logprintf(LOG_ERR, "failed to accept client");
-                exit(EXIT_FAILURE);
-            }
-			if(whitelist_check(inet_ntoa(address.sin_addr)) != 0) {
-				logprintf(LOG_INFO, "rejected client, ip: %s, port: %d", inet_ntoa(address.sin_addr), ntohs(address.sin_port));
-				shutdown(socket_client, 2);
-				close(socket_client);
-			} else {
-				//inform user of socket number - used in send and receive commands
-				logprintf(LOG_INFO, "new client, ip: %s, port: %d", inet_ntoa(address.sin_addr), ntohs(address.sin_port));
-				logprintf(LOG_DEBUG, "client fd: %d", socket_client);
-				//send new connection accept message
-				//socket_write(socket_client, "{\"message\":\"accept connection\"}");
-
-				static struct linger linger = { 0, 0 };
-				socklen_t lsize = sizeof(struct linger);
-				setsockopt(socket_client, SOL_SOCKET, SO_LINGER, (void *)&linger, lsize);
-				int flags = fcntl(socket_client, F_GETFL, 0);
-				if(flags != -1) {
-					fcntl(socket_client, F_SETFL, flags | O_NONBLOCK);
-				}
-
-				//add new socket to array of sockets
-				for(i=0;i<MAX_CLIENTS;i++) {
-					//if position is empty
-					if(socket_clients[i] == 0) {
-						socket_clients[i] = socket_client;
-						if(socket_callback->client_connected_callback)
-							socket_callback->client_connected_callback(i);
-						logprintf(LOG_DEBUG, "client id: %d", i);
-						break;
-					}
-				}
+		for(x=0;x<n;x++) {
+			//If something happened on one of the listeners, then its an incoming connection
+			if(events[x].id < 0) {
+				socket_accept(events[x].fd, socket_callback);
+				continue;
 			}
-        }
 
-		//else its some IO operation on some other socket :)
-		for(i=1;i<MAX_CLIENTS;i++) {
-			sd = socket_clients[i];
-			if(FD_ISSET((unsigned long)socket_clients[i], &readfds)) {
-				FD_CLR((unsigned long)socket_clients[i], &readfds);
-				char *message = NULL;
-				if((message = socket_read(sd)) != NULL) {
-					if(socket_callback->client_data_callback) {
-						size_t l = strlen(message);
-						if(l > 0) {
-							if(strstr(message, "\n") != NULL) {
-								char *buffer = malloc(l+1);
-								strcpy(buffer, message);
-								char *pch = strtok(buffer, "\n");
-								while(pch != NULL) {
-									socket_callback->client_data_callback(i, pch);
-									pch = strtok(NULL, "\n");
-								}
-								sfree((void *)&pch);
-								sfree((void *)&buffer);
-							} else {
-								socket_callback->client_data_callback(i, message);
-							}
-						}
-					}
-					sfree((void *)&message);
-				} else {
-					socket_rm_client(i, socket_callback);
-					i--;
+			//else its some IO operation on some other socket :)
+			i = events[x].id;
+			sd = events[x].fd;
+			if(socket_get_clients(i) != sd) {
+				continue;
+			}
+			if(events[x].write) {
+				pthread_mutex_lock(&socket_lock);
+				if(i < socket_nrclients && socket_clients[i].fd == sd) {
+					socket_output_flush(&socket_clients[i]);
 				}
+				pthread_mutex_unlock(&socket_lock);
+			}
+			if(events[x].read == 0) {
+				continue;
+			}
+			if(socket_client_read(i, sd, socket_callback) == -1 && socket_get_clients(i) == sd) {
+				socket_rm_client(i, sd, socket_callback);
 			}
 		}
     }
+
+	pthread_mutex_lock(&socket_lock);
+	for(i=0;i<socket_nrclients;i++) {
+		socket_output_clear(&socket_clients[i]);
+		socket_framer_free(&socket_clients[i].framer);
+	}
+	sfree((void *)&socket_clients);
+	socket_nrclients = 0;
+	pthread_mutex_unlock(&socket_lock);
+	if(socket_poll > -1) {
+		close(socket_poll);
+		socket_poll = -1;
+	}
 	return NULL;
 }
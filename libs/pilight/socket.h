@@ -19,22 +19,50 @@
 #ifndef _SOCKETS_H_
 #define _SOCKETS_H_
 
+#include "json.h"
+
+/* Clients can ask for binary messages by adding "format":"binary" to
+   their handshake. Once accepted, every message in both directions is
+   a single MessagePack value preceded by its length in four bytes,
+   most significant byte first. */
+#define SOCKET_HEADER		4
+
 typedef struct socket_callback_t {
     void (*client_connected_callback)(int);
     void (*client_disconnected_callback)(int);
     void (*client_data_callback)(int, char*);
+    void (*client_json_callback)(int, JsonNode*);
 } socket_callback_t;
 
+/* A message serialized once, shared by all clients it's written to */
+typedef struct socket_frame_t {
+	char *data;
+	size_t len;
+	int refs;
+} socket_frame_t;
+
 /* Start the socket server */
 int socket_start(unsigned short port);
+/* Also accept local clients on a unix domain socket */
+int socket_start_local(const char *path);
 int socket_connect(char *address, unsigned short port);
 void socket_close(int i);
 int socket_write(int sockfd, const char *msg, ...);
+/* Write json in the format the connection asked for */
+int socket_write_json(int sockfd, JsonNode *json);
 char *socket_read(int sockfd);
+struct socket_frame_t *socket_frame_create(const char *msg);
+struct socket_frame_t *socket_frame_create_binary(JsonNode *json);
+void socket_frame_free(struct socket_frame_t *frame);
+/* Queue a frame for client i without waiting for it to be written */
+int socket_write_frame(int i, struct socket_frame_t *frame);
 void *socket_wait(void *param);
 int socket_gc(void);
 unsigned int socket_get_port(void);
+char *socket_get_path(void);
 int socket_get_fd(void);
 int socket_get_clients(int i);
+void socket_set_binary(int sockfd);
+int socket_get_binary(int i);
 
 #endif
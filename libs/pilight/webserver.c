@@ -45,6 +45,7 @@
 #include "settings.h"
 #include "ssdp.h"
 #include "fcache.h"
+#include "queue.h"
 
 static int webserver_port = WEBSERVER_PORT;
 static int webserver_cache = 1;
@@ -78,6 +79,7 @@ typedef struct webqueue_t {
 
 static struct webqueue_t *webqueue;
 static struct webqueue_t *webqueue_head;
+static struct queue_t *webqueue_nodes = NULL;
 
 static pthread_mutex_t webqueue_lock;
 static pthread_cond_t webqueue_signal;
@@ -751,13 +753,10 @@ static void *webserver_worker(void *param) {
 }
 
 static void webserver_queue(char *message) {
+	struct webqueue_t *wnode = NULL;
+
 	pthread_mutex_lock(&webqueue_lock);
-	if(webqueue_number <= 1024) {
-		struct webqueue_t *wnode = malloc(sizeof(struct webqueue_t));
-		if(!wnode) {
-			logprintf(LOG_ERR, "out of memory");
-			exit(EXIT_FAILURE);
-		}
+	if((wnode = queue_alloc(webqueue_nodes)) != NULL) {
 		wnode->message = malloc(strlen(message)+1);
 		if(!wnode->message) {
 			logprintf(LOG_ERR, "out of memory");
@@ -788,6 +787,7 @@ void *webserver_broadcast(void *param) {
 	while(webserver_loop) {
 		if(webqueue_number > 0) {
 			pthread_mutex_lock(&webqueue_lock);
+			queue_dequeued(webqueue_nodes, webqueue);
 
 			for(i=0;i<WEBSERVER_WORKERS;i++) {
 				mg_iterate_over_connections(mgserver[i], webserver_sockets_callback, webqueue->message);
@@ -796,7 +796,7 @@ void *webserver_broadcast(void *param) {
 			struct webqueue_t *tmp = webqueue;
 			sfree((void *)&webqueue->message);
 			webqueue = webqueue->next;
-			sfree((void *)&tmp);
+			queue_free(webqueue_nodes, tmp);
 			webqueue_number--;
 			pthread_mutex_unlock(&webqueue_lock);
 		} else {
@@ -814,7 +814,10 @@ void *webserver_clientize(void *param) {
 	int standalone = 0;
 
 	settings_find_number("standalone", &standalone);
-	if(ssdp_seek(&ssdp_list) == -1 || standalone == 1) {
+	/* Our own daemon can be reached without going through the network */
+	if(socket_get_path() && (sockfd = socket_connect(socket_get_path(), 0)) != -1) {
+		logprintf(LOG_DEBUG, "connected to pilight-daemon through %s", socket_get_path());
+	} else if(ssdp_seek(&ssdp_list) == -1 || standalone == 1) {
 		logprintf(LOG_DEBUG, "no pilight ssdp connections found");
 		char server[16] = "127.0.0.1";
 		if((sockfd = socket_connect(server, (unsigned short)socket_get_port())) == -1) {
@@ -909,6 +912,7 @@ int webserver_start(void) {
 	pthread_mutexattr_init(&webqueue_attr);
 	pthread_mutexattr_settype(&webqueue_attr, PTHREAD_MUTEX_RECURSIVE);
 	pthread_mutex_init(&webqueue_lock, &webqueue_attr);
+	webqueue_nodes = queue_create("webserver", WEBSERVER_QUEUE_SIZE, sizeof(struct webqueue_t));
 
 	/* Check on what port the webserver needs to run */
 	settings_find_number("webserver-port", &webserver_port);
@@ -39,17 +39,14 @@ typedef struct alecto_wsd17_settings_t {
 
 static struct alecto_wsd17_settings_t *alecto_wsd17_settings = NULL;
 
-static void alectoWSD17ParseCode(void) {
-	int i = 0, x = 0;
+static void alectoWSD17ParseCode(struct protocol_decode_t *decode) {
 	int temperature = 0, id = 0;
 	int temp_offset = 0;
 
-	for(i=1;i<alecto_wsd17->rawlen-1;i+=2) {
-		alecto_wsd17->binary[x++] = alecto_wsd17->code[i];
-	}
+	binPackCode(decode->code, alecto_wsd17->rawlen-2, 1, 2, decode->packed);
 
-	id = binToDecRev(alecto_wsd17->binary, 0, 11);
-	temperature = binToDecRev(alecto_wsd17->binary, 16, 27);
+	id = (int)binPackedToDecRev(decode->packed, 0, 11);
+	temperature = (int)binPackedToDecRev(decode->packed, 16, 27);
 
 	struct alecto_wsd17_settings_t *tmp = alecto_wsd17_settings;
 	while(tmp) {
@@ -62,9 +59,9 @@ static void alectoWSD17ParseCode(void) {
 
 	temperature += temp_offset;
 
-	alecto_wsd17->message = json_mkobject();
-	json_append_member(alecto_wsd17->message, "id", json_mknumber(id));
-	json_append_member(alecto_wsd17->message, "temperature", json_mknumber(temperature));
+	decode->message = json_mkobject();
+	json_append_member(decode->message, "id", json_mknumber(id));
+	json_append_member(decode->message, "temperature", json_mknumber(temperature));
 }
 
 static int alectoWSD17CheckValues(struct JsonNode *jvalues) {
@@ -148,7 +145,7 @@ void alectoWSD17Init(void) {
 	options_add(&alecto_wsd17->options, 0, "gui-show-temperature", OPTION_HAS_VALUE, CONFIG_SETTING, JSON_NUMBER, (void *)1, "^[10]{1}$");
 	options_add(&alecto_wsd17->options, 0, "gui-show-battery", OPTION_HAS_VALUE, CONFIG_SETTING, JSON_NUMBER, (void *)1, "^[10]{1}$");
 
-	alecto_wsd17->parseCode=&alectoWSD17ParseCode;
+	alecto_wsd17->decodeCode=&alectoWSD17ParseCode;
 	alecto_wsd17->checkValues=&alectoWSD17CheckValues;
 	alecto_wsd17->gc=&alectoWSD17GC;
 }
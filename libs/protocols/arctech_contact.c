@@ -30,29 +30,29 @@
 #include "gc.h"
 #include "arctech_contact.h"
 
-static void arctechContactCreateMessage(int id, int unit, int state, int all) {
-	arctech_contact->message = json_mkobject();
-	json_append_member(arctech_contact->message, "id", json_mknumber(id));
+static void arctechContactCreateMessage(struct protocol_decode_t *decode, int id, int unit, int state, int all) {
+	decode->message = json_mkobject();
+	json_append_member(decode->message, "id", json_mknumber(id));
 	if(all == 1) {
-		json_append_member(arctech_contact->message, "all", json_mknumber(all));
+		json_append_member(decode->message, "all", json_mknumber(all));
 	} else {
-		json_append_member(arctech_contact->message, "unit", json_mknumber(unit));
+		json_append_member(decode->message, "unit", json_mknumber(unit));
 	}
 
 	if(state == 1) {
-		json_append_member(arctech_contact->message, "state", json_mkstring("opened"));
+		json_append_member(decode->message, "state", json_mkstring("opened"));
 	} else {
-		json_append_member(arctech_contact->message, "state", json_mkstring("closed"));
+		json_append_member(decode->message, "state", json_mkstring("closed"));
 	}
 }
 
-static void arctechContactParseBinary(void) {
-	int unit = binToDecRev(arctech_contact->binary, 28, 31);
-	int state = arctech_contact->binary[27];
-	int all = arctech_contact->binary[26];
-	int id = binToDecRev(arctech_contact->binary, 0, 25);
+static void arctechContactParseBinary(struct protocol_decode_t *decode) {
+	int unit = (int)binPackedToDecRev(decode->packed, 28, 31);
+	int state = binPackedGet(decode->packed, 27);
+	int all = binPackedGet(decode->packed, 26);
+	int id = (int)binPackedToDecRev(decode->packed, 0, 25);
 
-	arctechContactCreateMessage(id, unit, state, all);
+	arctechContactCreateMessage(decode, id, unit, state, all);
 }
 
 #ifndef MODULE
@@ -80,7 +80,7 @@ void arctechContactInit(void) {
 	options_add(&arctech_contact->options, 'a', "all", OPTION_HAS_VALUE, CONFIG_SETTING, JSON_NUMBER, (void *)0, "^[10]{1}$");
 	options_add(&arctech_contact->options, 0, "gui-readonly", OPTION_HAS_VALUE, CONFIG_SETTING, JSON_NUMBER, (void *)0, "^[10]{1}$");
 
-	arctech_contact->parseBinary=&arctechContactParseBinary;
+	arctech_contact->decodeBinary=&arctechContactParseBinary;
 }
 
 #ifdef MODULE
@@ -31,33 +31,34 @@
 #include "gc.h"
 #include "arctech_dimmer.h"
 
-static void arctechDimCreateMessage(int id, int unit, int state, int all, int dimlevel) {
-	arctech_dimmer->message = json_mkobject();
-	json_append_member(arctech_dimmer->message, "id", json_mknumber(id));
+static JsonNode *arctechDimCreateMessage(int id, int unit, int state, int all, int dimlevel) {
+	JsonNode *message = json_mkobject();
+	json_append_member(message, "id", json_mknumber(id));
 	if(all == 1) {
-		json_append_member(arctech_dimmer->message, "all", json_mknumber(all));
+		json_append_member(message, "all", json_mknumber(all));
 	} else {
-		json_append_member(arctech_dimmer->message, "unit", json_mknumber(unit));
+		json_append_member(message, "unit", json_mknumber(unit));
 	}
 	if(dimlevel >= 0) {
 		state = 1;
-		json_append_member(arctech_dimmer->message, "dimlevel", json_mknumber(dimlevel));
+		json_append_member(message, "dimlevel", json_mknumber(dimlevel));
 	}
 	if(state == 1) {
-		json_append_member(arctech_dimmer->message, "state", json_mkstring("on"));
+		json_append_member(message, "state", json_mkstring("on"));
 	} else {
-		json_append_member(arctech_dimmer->message, "state", json_mkstring("off"));
+		json_append_member(message, "state", json_mkstring("off"));
 	}
+	return message;
 }
 
-static void arctechDimParseBinary(void) {
-	int dimlevel = binToDecRev(arctech_dimmer->binary, 32, 35);
-	int unit = binToDecRev(arctech_dimmer->binary, 28, 31);
-	int state = arctech_dimmer->binary[27];
-	int all = arctech_dimmer->binary[26];
-	int id = binToDecRev(arctech_dimmer->binary, 0, 25);
+static void arctechDimParseBinary(struct protocol_decode_t *decode) {
+	int dimlevel = (int)binPackedToDecRev(decode->packed, 32, 35);
+	int unit = (int)binPackedToDecRev(decode->packed, 28, 31);
+	int state = binPackedGet(decode->packed, 27);
+	int all = binPackedGet(decode->packed, 26);
+	int id = (int)binPackedToDecRev(decode->packed, 0, 25);
 
-	arctechDimCreateMessage(id, unit, state, all, dimlevel);
+	decode->message = arctechDimCreateMessage(id, unit, state, all, dimlevel);
 }
 
 static void arctechDimCreateLow(int s, int e) {
@@ -232,7 +233,7 @@ static int arctechDimCreateCode(JsonNode *code) {
 		if(dimlevel >= 0) {
 			state = -1;
 		}
-		arctechDimCreateMessage(id, unit, state, all, dimlevel);
+		arctech_dimmer->message = arctechDimCreateMessage(id, unit, state, all, dimlevel);
 		arctechDimCreateStart();
 		arctechDimClearCode();
 		arctechDimCreateId(id);
@@ -280,7 +281,7 @@ void arctechDimInit(void) {
 	options_add(&arctech_dimmer->options, 0, "dimlevel-maximum", OPTION_HAS_VALUE, CONFIG_SETTING, JSON_NUMBER, (void *)15, "^([0-9]{1}|[1][0-5])$");
 	options_add(&arctech_dimmer->options, 0, "gui-readonly", OPTION_HAS_VALUE, CONFIG_SETTING, JSON_NUMBER, (void *)0, "^[10]{1}$");
 
-	arctech_dimmer->parseBinary=&arctechDimParseBinary;
+	arctech_dimmer->decodeBinary=&arctechDimParseBinary;
 	arctech_dimmer->createCode=&arctechDimCreateCode;
 	arctech_dimmer->printHelp=&arctechDimPrintHelp;
 	arctech_dimmer->checkValues=&arctechDimCheckValues;
@@ -31,29 +31,30 @@
 #include "gc.h"
 #include "arctech_screen.h"
 
-static void arctechSrCreateMessage(int id, int unit, int state, int all) {
-	arctech_screen->message = json_mkobject();
-	json_append_member(arctech_screen->message, "id", json_mknumber(id));
+static JsonNode *arctechSrCreateMessage(int id, int unit, int state, int all) {
+	JsonNode *message = json_mkobject();
+	json_append_member(message, "id", json_mknumber(id));
 	if(all == 1) {
-		json_append_member(arctech_screen->message, "all", json_mknumber(all));
+		json_append_member(message, "all", json_mknumber(all));
 	} else {
-		json_append_member(arctech_screen->message, "unit", json_mknumber(unit));
+		json_append_member(message, "unit", json_mknumber(unit));
 	}
 
 	if(state == 1) {
-		json_append_member(arctech_screen->message, "state", json_mkstring("up"));
+		json_append_member(message, "state", json_mkstring("up"));
 	} else {
-		json_append_member(arctech_screen->message, "state", json_mkstring("down"));
+		json_append_member(message, "state", json_mkstring("down"));
 	}
+	return message;
 }
 
-static void arctechSrParseBinary(void) {
-	int unit = binToDecRev(arctech_screen->binary, 28, 31);
-	int state = arctech_screen->binary[27];
-	int all = arctech_screen->binary[26];
-	int id = binToDecRev(arctech_screen->binary, 0, 25);
+static void arctechSrParseBinary(struct protocol_decode_t *decode) {
+	int unit = (int)binPackedToDecRev(decode->packed, 28, 31);
+	int state = binPackedGet(decode->packed, 27);
+	int all = binPackedGet(decode->packed, 26);
+	int id = (int)binPackedToDecRev(decode->packed, 0, 25);
 
-	arctechSrCreateMessage(id, unit, state, all);
+	decode->message = arctechSrCreateMessage(id, unit, state, all);
 }
 
 static void arctechSrCreateLow(int s, int e) {
@@ -162,7 +163,7 @@ static int arctechSrCreateCode(JsonNode *code) {
 		if(unit == -1 && all == 1) {
 			unit = 0;
 		}
-		arctechSrCreateMessage(id, unit, state, all);
+		arctech_screen->message = arctechSrCreateMessage(id, unit, state, all);
 		arctechSrCreateStart();
 		arctechSrClearCode();
 		arctechSrCreateId(id);
@@ -207,7 +208,7 @@ void arctechSrInit(void) {
 
 	options_add(&arctech_screen->options, 0, "gui-readonly", OPTION_HAS_VALUE, CONFIG_SETTING, JSON_NUMBER, (void *)0, "^[10]{1}$");
 
-	arctech_screen->parseBinary=&arctechSrParseBinary;
+	arctech_screen->decodeBinary=&arctechSrParseBinary;
 	arctech_screen->createCode=&arctechSrCreateCode;
 	arctech_screen->printHelp=&arctechSrPrintHelp;
 }
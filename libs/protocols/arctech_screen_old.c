@@ -31,21 +31,22 @@
 #include "gc.h"
 #include "arctech_screen_old.h"
 
-static void arctechSrOldCreateMessage(int id, int unit, int state) {
-	arctech_screen_old->message = json_mkobject();
-	json_append_member(arctech_screen_old->message, "id", json_mknumber(id));
-	json_append_member(arctech_screen_old->message, "unit", json_mknumber(unit));
+static JsonNode *arctechSrOldCreateMessage(int id, int unit, int state) {
+	JsonNode *message = json_mkobject();
+	json_append_member(message, "id", json_mknumber(id));
+	json_append_member(message, "unit", json_mknumber(unit));
 	if(state == 1)
-		json_append_member(arctech_screen_old->message, "state", json_mkstring("up"));
+		json_append_member(message, "state", json_mkstring("up"));
 	else
-		json_append_member(arctech_screen_old->message, "state", json_mkstring("down"));
+		json_append_member(message, "state", json_mkstring("down"));
+	return message;
 }
 
-static void arctechSrOldParseBinary(void) {
-	int unit = binToDec(arctech_screen_old->binary, 0, 3);
-	int state = arctech_screen_old->binary[11];
-	int id = binToDec(arctech_screen_old->binary, 4, 8);
-	arctechSrOldCreateMessage(id, unit, state);
+static void arctechSrOldParseBinary(struct protocol_decode_t *decode) {
+	int unit = (int)binPackedToDec(decode->packed, 0, 3);
+	int state = binPackedGet(decode->packed, 11);
+	int id = (int)binPackedToDec(decode->packed, 4, 8);
+	decode->message = arctechSrOldCreateMessage(id, unit, state);
 }
 
 static void arctechSrOldCreateLow(int s, int e) {
@@ -139,7 +140,7 @@ static int arctechSrOldCreateCode(JsonNode *code) {
 		logprintf(LOG_ERR, "arctech_screen_old: invalid unit range");
 		return EXIT_FAILURE;
 	} else {
-		arctechSrOldCreateMessage(id, unit, state);
+		arctech_screen_old->message = arctechSrOldCreateMessage(id, unit, state);
 		arctechSrOldClearCode();
 		arctechSrOldCreateUnit(unit);
 		arctechSrOldCreateId(id);
@@ -179,7 +180,7 @@ void arctechSrOldInit(void) {
 
 	options_add(&arctech_screen_old->options, 0, "gui-readonly", OPTION_HAS_VALUE, CONFIG_SETTING, JSON_NUMBER, (void *)0, "^[10]{1}$");
 
-	arctech_screen_old->parseBinary=&arctechSrOldParseBinary;
+	arctech_screen_old->decodeBinary=&arctechSrOldParseBinary;
 	arctech_screen_old->createCode=&arctechSrOldCreateCode;
 	arctech_screen_old->printHelp=&arctechSrOldPrintHelp;
 }
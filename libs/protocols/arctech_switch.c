@@ -31,29 +31,30 @@
 #include "gc.h"
 #include "arctech_switch.h"
 
-static void arctechSwCreateMessage(int id, int unit, int state, int all) {
-	arctech_switch->message = json_mkobject();
-	json_append_member(arctech_switch->message, "id", json_mknumber(id));
+static JsonNode *arctechSwCreateMessage(int id, int unit, int state, int all) {
+	JsonNode *message = json_mkobject();
+	json_append_member(message, "id", json_mknumber(id));
 	if(all == 1) {
-		json_append_member(arctech_switch->message, "all", json_mknumber(all));
+		json_append_member(message, "all", json_mknumber(all));
 	} else {
-		json_append_member(arctech_switch->message, "unit", json_mknumber(unit));
+		json_append_member(message, "unit", json_mknumber(unit));
 	}
 
 	if(state == 1) {
-		json_append_member(arctech_switch->message, "state", json_mkstring("on"));
+		json_append_member(message, "state", json_mkstring("on"));
 	} else {
-		json_append_member(arctech_switch->message, "state", json_mkstring("off"));
+		json_append_member(message, "state", json_mkstring("off"));
 	}
+	return message;
 }
 
-static void arctechSwParseBinary(void) {
-	int unit = binToDecRev(arctech_switch->binary, 28, 31);
-	int state = arctech_switch->binary[27];
-	int all = arctech_switch->binary[26];
-	int id = binToDecRev(arctech_switch->binary, 0, 25);
+static void arctechSwParseBinary(struct protocol_decode_t *decode) {
+	int unit = (int)binPackedToDecRev(decode->packed, 28, 31);
+	int state = binPackedGet(decode->packed, 27);
+	int all = binPackedGet(decode->packed, 26);
+	int id = (int)binPackedToDecRev(decode->packed, 0, 25);
 
-	arctechSwCreateMessage(id, unit, state, all);
+	decode->message = arctechSwCreateMessage(id, unit, state, all);
 }
 
 static void arctechSwCreateLow(int s, int e) {
@@ -162,7 +163,7 @@ static int arctechSwCreateCode(JsonNode *code) {
 		if(unit == -1 && all == 1) {
 			unit = 0;
 		}
-		arctechSwCreateMessage(id, unit, state, all);
+		arctech_switch->message = arctechSwCreateMessage(id, unit, state, all);
 		arctechSwCreateStart();
 		arctechSwClearCode();
 		arctechSwCreateId(id);
@@ -210,7 +211,7 @@ void arctechSwInit(void) {
 
 	options_add(&arctech_switch->options, 0, "gui-readonly", OPTION_HAS_VALUE, CONFIG_SETTING, JSON_NUMBER, (void *)0, "^[10]{1}$");
 
-	arctech_switch->parseBinary=&arctechSwParseBinary;
+	arctech_switch->decodeBinary=&arctechSwParseBinary;
 	arctech_switch->createCode=&arctechSwCreateCode;
 	arctech_switch->printHelp=&arctechSwPrintHelp;
 }
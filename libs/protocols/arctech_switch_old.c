@@ -31,21 +31,22 @@
 #include "gc.h"
 #include "arctech_switch_old.h"
 
-static void arctechSwOldCreateMessage(int id, int unit, int state) {
-	arctech_switch_old->message = json_mkobject();
-	json_append_member(arctech_switch_old->message, "id", json_mknumber(id));
-	json_append_member(arctech_switch_old->message, "unit", json_mknumber(unit));
+static JsonNode *arctechSwOldCreateMessage(int id, int unit, int state) {
+	JsonNode *message = json_mkobject();
+	json_append_member(message, "id", json_mknumber(id));
+	json_append_member(message, "unit", json_mknumber(unit));
 	if(state == 1)
-		json_append_member(arctech_switch_old->message, "state", json_mkstring("on"));
+		json_append_member(message, "state", json_mkstring("on"));
 	else
-		json_append_member(arctech_switch_old->message, "state", json_mkstring("off"));
+		json_append_member(message, "state", json_mkstring("off"));
+	return message;
 }
 
-static void arctechSwOldParseBinary(void) {
-	int unit = binToDec(arctech_switch_old->binary, 0, 3);
-	int state = arctech_switch_old->binary[11];
-	int id = binToDec(arctech_switch_old->binary, 4, 8);
-	arctechSwOldCreateMessage(id, unit, state);
+static void arctechSwOldParseBinary(struct protocol_decode_t *decode) {
+	int unit = (int)binPackedToDec(decode->packed, 0, 3);
+	int state = binPackedGet(decode->packed, 11);
+	int id = (int)binPackedToDec(decode->packed, 4, 8);
+	decode->message = arctechSwOldCreateMessage(id, unit, state);
 }
 
 static void arctechSwOldCreateLow(int s, int e) {
@@ -139,7 +140,7 @@ static int arctechSwOldCreateCode(JsonNode *code) {
 		logprintf(LOG_ERR, "arctech_switch_old: invalid unit range");
 		return EXIT_FAILURE;
 	} else {
-		arctechSwOldCreateMessage(id, unit, state);
+		arctech_switch_old->message = arctechSwOldCreateMessage(id, unit, state);
 		arctechSwOldClearCode();
 		arctechSwOldCreateUnit(unit);
 		arctechSwOldCreateId(id);
@@ -185,7 +186,7 @@ void arctechSwOldInit(void) {
 
 	options_add(&arctech_switch_old->options, 0, "gui-readonly", OPTION_HAS_VALUE, CONFIG_SETTING, JSON_NUMBER, (void *)0, "^[10]{1}$");
 
-	arctech_switch_old->parseBinary=&arctechSwOldParseBinary;
+	arctech_switch_old->decodeBinary=&arctechSwOldParseBinary;
 	arctech_switch_old->createCode=&arctechSwOldCreateCode;
 	arctech_switch_old->printHelp=&arctechSwOldPrintHelp;
 }
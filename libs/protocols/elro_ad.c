@@ -39,23 +39,24 @@
  * state : either 2 (off) or 1 (on)
  * group : if 1 this affects a whole group of devices
  */
-static void elroADCreateMessage(unsigned long long systemcode, int unitcode, int state, int group) {
-	elro_ad->message = json_mkobject();
+static JsonNode *elroADCreateMessage(unsigned long long systemcode, int unitcode, int state, int group) {
+	JsonNode *message = json_mkobject();
 	//aka address
-	json_append_member(elro_ad->message, "systemcode", json_mknumber((double)systemcode));
+	json_append_member(message, "systemcode", json_mknumber((double)systemcode));
 	//toggle all or just one unit
 	if(group == 1) {
-	    json_append_member(elro_ad->message, "all", json_mknumber(group));
+	    json_append_member(message, "all", json_mknumber(group));
 	} else {
-	    json_append_member(elro_ad->message, "unitcode", json_mknumber(unitcode));
+	    json_append_member(message, "unitcode", json_mknumber(unitcode));
 	}
 	//aka command
 	if(state == 1) {
-		json_append_member(elro_ad->message, "state", json_mkstring("on"));
+		json_append_member(message, "state", json_mkstring("on"));
 	}
 	else if(state == 2) {
-		json_append_member(elro_ad->message, "state", json_mkstring("off"));
+		json_append_member(message, "state", json_mkstring("off"));
 	}
+	return message;
 }
 
 /**
@@ -63,26 +64,26 @@ static void elroADCreateMessage(unsigned long long systemcode, int unitcode, int
  * Decodes the received stream
  *
  */
-static void elroADParseCode(void) {
+static void elroADParseCode(struct protocol_decode_t *decode) {
 	int i = 0;
 	//utilize the "code" field
 	//at this point the code field holds translated "0" and "1" codes from the received pulses
 	//this means that we have to combine these ourselves into meaningful values in groups of 2
 
 	for(i = 0; i < elro_ad->rawlen/2; i +=1) {
-		if(elro_ad->code[i*2] != 0) {
+		if(decode->code[i*2] != 0) {
 			//these are always zero - this is not a valid code
 			return;
 		}
-		elro_ad->binary[i] = elro_ad->code[(i*2)+1];
 	}
+	binPackCode(decode->code, elro_ad->rawlen, 1, 2, decode->packed);
 
 	//chunked code now contains "groups of 2" codes for us to handle.
-	unsigned long long systemcode = binToDecRevUl(elro_ad->binary, 11, 42);
-	int groupcode = binToDec(elro_ad->binary, 43, 46);
-	int groupcode2 = binToDec(elro_ad->binary, 49, 50);
-	int unitcode = binToDec(elro_ad->binary, 51, 56);
-	int state = binToDec(elro_ad->binary, 47, 48);
+	unsigned long long systemcode = binPackedToDecRev(decode->packed, 11, 42);
+	int groupcode = (int)binPackedToDec(decode->packed, 43, 46);
+	int groupcode2 = (int)binPackedToDec(decode->packed, 49, 50);
+	int unitcode = (int)binPackedToDec(decode->packed, 51, 56);
+	int state = (int)binPackedToDec(decode->packed, 47, 48);
 	int groupRes = 0;
 
 	if(groupcode == 13 && groupcode2 == 2) {
@@ -95,7 +96,7 @@ static void elroADParseCode(void) {
 	if(state < 1 || state > 2) {
 		return;
 	} else {
-		elroADCreateMessage(systemcode, unitcode, state, groupRes);
+		decode->message = elroADCreateMessage(systemcode, unitcode, state, groupRes);
 	}
 }
 
@@ -269,7 +270,7 @@ static int elroADCreateCode(JsonNode *code) {
 	} else if(systemcode > 4294967295u || unitcode > 99 || unitcode < 0) {
 		logprintf(LOG_ERR, "elro_ad: values out of valid range");
 	} else {
-		elroADCreateMessage(systemcode, unitcode, state, group);
+		elro_ad->message = elroADCreateMessage(systemcode, unitcode, state, group);
 		elroADClearCode();
 		elroADCreatePreamble();
 		elroADCreateSystemCode(systemcode);
@@ -318,7 +319,7 @@ void elroADInit(void) {
 	options_add(&elro_ad->options, 0, "gui-readonly", OPTION_HAS_VALUE, CONFIG_SETTING, JSON_NUMBER, (void *)0, "^[10]{1}$");
 
 
-	elro_ad->parseCode=&elroADParseCode;
+	elro_ad->decodeCode=&elroADParseCode;
 	elro_ad->createCode=&elroADCreateCode;
 	elro_ad->printHelp=&elroADPrintHelp;
 }
@@ -31,26 +31,25 @@
 #include "gc.h"
 #include "elro_hc.h"
 
-static void elroHCCreateMessage(int systemcode, int unitcode, int state) {
-	elro_hc->message = json_mkobject();
-	json_append_member(elro_hc->message, "systemcode", json_mknumber(systemcode));
-	json_append_member(elro_hc->message, "unitcode", json_mknumber(unitcode));
+static JsonNode *elroHCCreateMessage(int systemcode, int unitcode, int state) {
+	JsonNode *message = json_mkobject();
+	json_append_member(message, "systemcode", json_mknumber(systemcode));
+	json_append_member(message, "unitcode", json_mknumber(unitcode));
 	if(state == 1) {
-		json_append_member(elro_hc->message, "state", json_mkstring("on"));
+		json_append_member(message, "state", json_mkstring("on"));
 	} else {
-		json_append_member(elro_hc->message, "state", json_mkstring("off"));
+		json_append_member(message, "state", json_mkstring("off"));
 	}
+	return message;
 }
 
-static void elroHCParseBinary(void) {
-	int x = 0;
-	for(x=0;x<elro_hc->binlen;x++) {
-		elro_hc->binary[x] ^= 1;
-	}
-	int systemcode = binToDecRev(elro_hc->binary, 0, 4);
-	int unitcode = binToDecRev(elro_hc->binary, 5, 9);
-	int state = elro_hc->binary[11];
-	elroHCCreateMessage(systemcode, unitcode, state);
+static void elroHCParseBinary(struct protocol_decode_t *decode) {
+	/* All bits are inverted, binlen fits in the first word */
+	decode->packed[0] = ~decode->packed[0];
+	int systemcode = (int)binPackedToDecRev(decode->packed, 0, 4);
+	int unitcode = (int)binPackedToDecRev(decode->packed, 5, 9);
+	int state = binPackedGet(decode->packed, 11);
+	decode->message = elroHCCreateMessage(systemcode, unitcode, state);
 }
 
 static void elroHCCreateLow(int s, int e) {
@@ -145,7 +144,7 @@ static int elroHCCreateCode(JsonNode *code) {
 		logprintf(LOG_ERR, "elro_hc: invalid unitcode range");
 		return EXIT_FAILURE;
 	} else {
-		elroHCCreateMessage(systemcode, unitcode, state);
+		elro_hc->message = elroHCCreateMessage(systemcode, unitcode, state);
 		elroHCClearCode();
 		elroHCCreateSystemCode(systemcode);
 		elroHCCreateUnitCode(unitcode);
@@ -186,7 +185,7 @@ void elroHCInit(void) {
 
 	options_add(&elro_hc->options, 0, "gui-readonly", OPTION_HAS_VALUE, CONFIG_SETTING, JSON_NUMBER, (void *)0, "^[10]{1}$");
 
-	elro_hc->parseBinary=&elroHCParseBinary;
+	elro_hc->decodeBinary=&elroHCParseBinary;
 	elro_hc->createCode=&elroHCCreateCode;
 	elro_hc->printHelp=&elroHCPrintHelp;
 }
@@ -31,22 +31,23 @@
 #include "gc.h"
 #include "elro_he.h"
 
-static void elroHECreateMessage(int systemcode, int unitcode, int state) {
-	elro_he->message = json_mkobject();
-	json_append_member(elro_he->message, "systemcode", json_mknumber(systemcode));
-	json_append_member(elro_he->message, "unitcode", json_mknumber(unitcode));
+static JsonNode *elroHECreateMessage(int systemcode, int unitcode, int state) {
+	JsonNode *message = json_mkobject();
+	json_append_member(message, "systemcode", json_mknumber(systemcode));
+	json_append_member(message, "unitcode", json_mknumber(unitcode));
 	if(state == 0) {
-		json_append_member(elro_he->message, "state", json_mkstring("on"));
+		json_append_member(message, "state", json_mkstring("on"));
 	} else {
-		json_append_member(elro_he->message, "state", json_mkstring("off"));
+		json_append_member(message, "state", json_mkstring("off"));
 	}
+	return message;
 }
 
-static void elroHEParseBinary(void) {
-	int systemcode = binToDec(elro_he->binary, 0, 4);
-	int unitcode = binToDec(elro_he->binary, 5, 9);
-	int state = elro_he->binary[11];
-	elroHECreateMessage(systemcode, unitcode, state);
+static void elroHEParseBinary(struct protocol_decode_t *decode) {
+	int systemcode = (int)binPackedToDec(decode->packed, 0, 4);
+	int unitcode = (int)binPackedToDec(decode->packed, 5, 9);
+	int state = binPackedGet(decode->packed, 11);
+	decode->message = elroHECreateMessage(systemcode, unitcode, state);
 }
 
 static void elroHECreateLow(int s, int e) {
@@ -138,7 +139,7 @@ static int elroHECreateCode(JsonNode *code) {
 		logprintf(LOG_ERR, "elro_he: invalid unitcode range");
 		return EXIT_FAILURE;
 	} else {
-		elroHECreateMessage(systemcode, unitcode, state);
+		elro_he->message = elroHECreateMessage(systemcode, unitcode, state);
 		elroHEClearCode();
 		elroHECreateSystemCode(systemcode);
 		elroHECreateUnitCode(unitcode);
@@ -178,7 +179,7 @@ void elroHEInit(void) {
 
 	options_add(&elro_he->options, 0, "gui-readonly", OPTION_HAS_VALUE, CONFIG_SETTING, JSON_NUMBER, (void *)0, "^[10]{1}$");
 
-	elro_he->parseBinary=&elroHEParseBinary;
+	elro_he->decodeBinary=&elroHEParseBinary;
 	elro_he->createCode=&elroHECreateCode;
 	elro_he->printHelp=&elroHEPrintHelp;
 }
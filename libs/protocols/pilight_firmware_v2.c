@@ -30,27 +30,27 @@
 #include "gc.h"
 #include "pilight_firmware_v2.h"
 
-static void pilightFirmwareV2CreateMessage(int version, int high, int low) {
-	pilight_firmware_v2->message = json_mkobject();
-	json_append_member(pilight_firmware_v2->message, "version", json_mknumber(version));
-	json_append_member(pilight_firmware_v2->message, "lpf", json_mknumber(high*10));
-	json_append_member(pilight_firmware_v2->message, "hpf", json_mknumber(low*10));
+static void pilightFirmwareV2CreateMessage(struct protocol_decode_t *decode, int version, int high, int low) {
+	decode->message = json_mkobject();
+	json_append_member(decode->message, "version", json_mknumber(version));
+	json_append_member(decode->message, "lpf", json_mknumber(high*10));
+	json_append_member(decode->message, "hpf", json_mknumber(low*10));
 }
 
-static void pilightFirmwareV2ParseRaw(void) {
+static void pilightFirmwareV2ParseRaw(struct protocol_decode_t *decode) {
 	int i = 0;
 	for(i=0;i<pilight_firmware_v2->rawlen;i++) {
-		if(pilight_firmware_v2->raw[i] < 100) {
-			pilight_firmware_v2->raw[i]*=10;
+		if(decode->raw[i] < 100) {
+			decode->raw[i]*=10;
 		}
 	}
 }
 
-static void pilightFirmwareV2ParseBinary(void) {
-	int version = binToDec(pilight_firmware_v2->binary, 0, 15);
-	int high = binToDec(pilight_firmware_v2->binary, 16, 31);
-	int low = binToDec(pilight_firmware_v2->binary, 32, 47);
-	pilightFirmwareV2CreateMessage(version, high, low);
+static void pilightFirmwareV2ParseBinary(struct protocol_decode_t *decode) {
+	int version = (int)binPackedToDec(decode->packed, 0, 15);
+	int high = (int)binPackedToDec(decode->packed, 16, 31);
+	int low = (int)binPackedToDec(decode->packed, 32, 47);
+	pilightFirmwareV2CreateMessage(decode, version, high, low);
 }
 
 #ifndef MODULE
@@ -74,8 +74,8 @@ void pilightFirmwareV2Init(void) {
   options_add(&pilight_firmware_v2->options, 'l', "lpf", OPTION_HAS_VALUE, CONFIG_ID, JSON_NUMBER, NULL, "^[0-9]+$");
   options_add(&pilight_firmware_v2->options, 'h', "hpf", OPTION_HAS_VALUE, CONFIG_ID, JSON_NUMBER, NULL, "^[0-9]+$");
 
-  pilight_firmware_v2->parseBinary=&pilightFirmwareV2ParseBinary;
-  pilight_firmware_v2->parseRaw=&pilightFirmwareV2ParseRaw;
+  pilight_firmware_v2->decodeBinary=&pilightFirmwareV2ParseBinary;
+  pilight_firmware_v2->decodeRaw=&pilightFirmwareV2ParseRaw;
 }
 
 #ifdef MODULE
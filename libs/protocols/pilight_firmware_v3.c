@@ -30,18 +30,18 @@
 #include "gc.h"
 #include "pilight_firmware_v3.h"
 
-static void pilightFirmwareV3CreateMessage(int version, int high, int low) {
-	pilight_firmware_v3->message = json_mkobject();
-	json_append_member(pilight_firmware_v3->message, "version", json_mknumber(version));
-	json_append_member(pilight_firmware_v3->message, "lpf", json_mknumber(high*10));
-	json_append_member(pilight_firmware_v3->message, "hpf", json_mknumber(low*10));
+static void pilightFirmwareV3CreateMessage(struct protocol_decode_t *decode, int version, int high, int low) {
+	decode->message = json_mkobject();
+	json_append_member(decode->message, "version", json_mknumber(version));
+	json_append_member(decode->message, "lpf", json_mknumber(high*10));
+	json_append_member(decode->message, "hpf", json_mknumber(low*10));
 }
 
-static void pilightFirmwareV3ParseBinary(void) {
-	int version = binToDec(pilight_firmware_v3->binary, 0, 15);
-	int high = binToDec(pilight_firmware_v3->binary, 16, 31);
-	int low = binToDec(pilight_firmware_v3->binary, 32, 47);
-	int chk = binToDec(pilight_firmware_v3->binary, 48, 51);
+static void pilightFirmwareV3ParseBinary(struct protocol_decode_t *decode) {
+	int version = (int)binPackedToDec(decode->packed, 0, 15);
+	int high = (int)binPackedToDec(decode->packed, 16, 31);
+	int low = (int)binPackedToDec(decode->packed, 32, 47);
+	int chk = (int)binPackedToDec(decode->packed, 48, 51);
 	int lpf = low;
 	int hpf = high;
 	int ver = version;
@@ -57,7 +57,7 @@ static void pilightFirmwareV3ParseBinary(void) {
 	}
 
 	if((((ver&0xf)+(lpf&0xf)+(hpf&0xf))&0xf) == chk) {
-		pilightFirmwareV3CreateMessage(version, high, low);
+		pilightFirmwareV3CreateMessage(decode, version, high, low);
 	}
 }
 
@@ -82,7 +82,7 @@ void pilightFirmwareV3Init(void) {
   options_add(&pilight_firmware_v3->options, 'l', "lpf", OPTION_HAS_VALUE, CONFIG_ID, JSON_NUMBER, NULL, "^[0-9]+$");
   options_add(&pilight_firmware_v3->options, 'h', "hpf", OPTION_HAS_VALUE, CONFIG_ID, JSON_NUMBER, NULL, "^[0-9]+$");
 
-  pilight_firmware_v3->parseBinary=&pilightFirmwareV3ParseBinary;
+  pilight_firmware_v3->decodeBinary=&pilightFirmwareV3ParseBinary;
 }
 
 #ifdef MODULE
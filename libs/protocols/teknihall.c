@@ -40,19 +40,16 @@ typedef struct teknihall_settings_t {
 
 static struct teknihall_settings_t *teknihall_settings = NULL;
 
-static void teknihallParseCode(void) {
-	int i = 0, x = 0;
+static void teknihallParseCode(struct protocol_decode_t *decode) {
 	int temperature = 0, id = 0, humidity = 0, battery = 0;
 	int humi_offset = 0, temp_offset = 0;
 
-	for(i=1;i<teknihall->rawlen-1;i+=2) {
-		teknihall->binary[x++] = teknihall->code[i];
-	}
+	binPackCode(decode->code, teknihall->rawlen-2, 1, 2, decode->packed);
 
-	id = binToDecRev(teknihall->binary, 0, 7);
-	battery = teknihall->binary[8];
-	temperature = binToDecRev(teknihall->binary, 14, 23);
-	humidity = binToDecRev(teknihall->binary, 24, 30);
+	id = (int)binPackedToDecRev(decode->packed, 0, 7);
+	battery = binPackedGet(decode->packed, 8);
+	temperature = (int)binPackedToDecRev(decode->packed, 14, 23);
+	humidity = (int)binPackedToDecRev(decode->packed, 24, 30);
 
 	struct teknihall_settings_t *tmp = teknihall_settings;
 	while(tmp) {
@@ -67,11 +64,11 @@ static void teknihallParseCode(void) {
 	temperature += temp_offset;
 	humidity += humi_offset;
 
-	teknihall->message = json_mkobject();
-	json_append_member(teknihall->message, "id", json_mknumber(id));
-	json_append_member(teknihall->message, "temperature", json_mknumber(temperature));
-	json_append_member(teknihall->message, "humidity", json_mknumber(humidity*10));
-	json_append_member(teknihall->message, "battery", json_mknumber(battery));
+	decode->message = json_mkobject();
+	json_append_member(decode->message, "id", json_mknumber(id));
+	json_append_member(decode->message, "temperature", json_mknumber(temperature));
+	json_append_member(decode->message, "humidity", json_mknumber(humidity*10));
+	json_append_member(decode->message, "battery", json_mknumber(battery));
 }
 
 static int teknihallCheckValues(struct JsonNode *jvalues) {
@@ -159,7 +156,7 @@ void teknihallInit(void) {
 	options_add(&teknihall->options, 0, "gui-show-temperature", OPTION_HAS_VALUE, CONFIG_SETTING, JSON_NUMBER, (void *)1, "^[10]{1}$");
 	options_add(&teknihall->options, 0, "gui-show-battery", OPTION_HAS_VALUE, CONFIG_SETTING, JSON_NUMBER, (void *)1, "^[10]{1}$");
 
-	teknihall->parseCode=&teknihallParseCode;
+	teknihall->decodeCode=&teknihallParseCode;
 	teknihall->checkValues=&teknihallCheckValues;
 	teknihall->gc=&teknihallGC;
 }
@@ -41,33 +41,30 @@ typedef struct tfa_settings_t {
 
 static struct tfa_settings_t *tfa_settings = NULL;
 
-static void tfaParseCode(void) {
+static void tfaParseCode(struct protocol_decode_t *decode) {
 	int temp1 = 0, temp2 = 0, temp3 = 0;
 	int humi1 = 0, humi2 = 0;
 	int temperature = 0, id = 0;
 	int humidity = 0, battery = 0;
 	int channel = 0;
-	int i = 0, x = 0;
 	int humi_offset = 0, temp_offset = 0;
 
-	for(i=1;i<tfa->rawlen-2;i+=2) {
-		tfa->binary[x++] = tfa->code[i];
-	}
+	binPackCode(decode->code, tfa->rawlen-3, 1, 2, decode->packed);
 
-	id = binToDecRev(tfa->binary, 2, 9);
-	channel = binToDecRev(tfa->binary, 12, 13) + 1;
+	id = (int)binPackedToDecRev(decode->packed, 2, 9);
+	channel = (int)binPackedToDecRev(decode->packed, 12, 13) + 1;
 
-	temp1 = binToDecRev(tfa->binary, 14, 17);
-	temp2 = binToDecRev(tfa->binary, 18, 21);
-	temp3 = binToDecRev(tfa->binary, 22, 25);
+	temp1 = (int)binPackedToDecRev(decode->packed, 14, 17);
+	temp2 = (int)binPackedToDecRev(decode->packed, 18, 21);
+	temp3 = (int)binPackedToDecRev(decode->packed, 22, 25);
 	                                                     /* Convert F to C */
 	temperature = (int)((float)(((((temp3*256) + (temp2*16) + (temp1))*10) - 9000) - 3200) * ((float)5/(float)9));
 
-	humi1 = binToDecRev(tfa->binary, 26, 29);
-	humi2 = binToDecRev(tfa->binary, 30, 33);
+	humi1 = (int)binPackedToDecRev(decode->packed, 26, 29);
+	humi2 = (int)binPackedToDecRev(decode->packed, 30, 33);
 	humidity = ((humi1)+(humi2*16))*100;
 
-	if(binToDecRev(tfa->code, 34, 35) > 1) {
+	if(binToDecRev(decode->code, 34, 35) > 1) {
 		battery = 0;
 	} else {
 		battery = 1;
@@ -86,12 +83,12 @@ static void tfaParseCode(void) {
 	temperature += temp_offset;
 	humidity += humi_offset;
 
-	tfa->message = json_mkobject();
-	json_append_member(tfa->message, "id", json_mknumber(id));
-	json_append_member(tfa->message, "temperature", json_mknumber(temperature));
-	json_append_member(tfa->message, "humidity", json_mknumber(humidity));
-	json_append_member(tfa->message, "battery", json_mknumber(battery));
-	json_append_member(tfa->message, "channel", json_mknumber(channel));
+	decode->message = json_mkobject();
+	json_append_member(decode->message, "id", json_mknumber(id));
+	json_append_member(decode->message, "temperature", json_mknumber(temperature));
+	json_append_member(decode->message, "humidity", json_mknumber(humidity));
+	json_append_member(decode->message, "battery", json_mknumber(battery));
+	json_append_member(decode->message, "channel", json_mknumber(channel));
 }
 
 static int tfaCheckValues(struct JsonNode *jvalues) {
@@ -187,7 +184,7 @@ void tfaInit(void) {
 	options_add(&tfa->options, 0, "gui-show-temperature", OPTION_HAS_VALUE, CONFIG_SETTING, JSON_NUMBER, (void *)1, "^[10]{1}$");
 	options_add(&tfa->options, 0, "gui-show-battery", OPTION_HAS_VALUE, CONFIG_SETTING, JSON_NUMBER, (void *)1, "^[10]{1}$");
 
-	tfa->parseCode=&tfaParseCode;
+	tfa->decodeCode=&tfaParseCode;
 	tfa->checkValues=&tfaCheckValues;
 	tfa->gc=&tfaGC;
 }
@@ -40,19 +40,16 @@ typedef struct threechan_settings_t {
 
 static struct threechan_settings_t *threechan_settings = NULL;
 
-static void threechanParseCode(void) {
-	int i = 0, x = 0;
+static void threechanParseCode(struct protocol_decode_t *decode) {
 	int temperature = 0, id = 0, humidity = 0, battery = 0;
 	int humi_offset = 0, temp_offset = 0;
 
-	for(i=1;i<threechan->rawlen-1;i+=2) {
-		threechan->binary[x++] = threechan->code[i];
-	}
+	binPackCode(decode->code, threechan->rawlen-2, 1, 2, decode->packed);
 
-	id = binToDecRev(threechan->binary, 0, 11);
-	battery = threechan->binary[12];
-	temperature = binToDecRev(threechan->binary, 18, 27);
-	humidity = binToDecRev(threechan->binary, 28, 35);
+	id = (int)binPackedToDecRev(decode->packed, 0, 11);
+	battery = binPackedGet(decode->packed, 12);
+	temperature = (int)binPackedToDecRev(decode->packed, 18, 27);
+	humidity = (int)binPackedToDecRev(decode->packed, 28, 35);
 
 	struct threechan_settings_t *tmp = threechan_settings;
 	while(tmp) {
@@ -67,11 +64,11 @@ static void threechanParseCode(void) {
 	temperature += temp_offset;
 	humidity += humi_offset;
 
-	threechan->message = json_mkobject();
-	json_append_member(threechan->message, "id", json_mknumber(id));
-	json_append_member(threechan->message, "temperature", json_mknumber(temperature));
-	json_append_member(threechan->message, "humidity", json_mknumber(humidity*10));
-	json_append_member(threechan->message, "battery", json_mknumber(battery));
+	decode->message = json_mkobject();
+	json_append_member(decode->message, "id", json_mknumber(id));
+	json_append_member(decode->message, "temperature", json_mknumber(temperature));
+	json_append_member(decode->message, "humidity", json_mknumber(humidity*10));
+	json_append_member(decode->message, "battery", json_mknumber(battery));
 }
 
 static int threechanCheckValues(struct JsonNode *jvalues) {
@@ -159,7 +156,7 @@ void threechanInit(void) {
 	options_add(&threechan->options, 0, "gui-show-temperature", OPTION_HAS_VALUE, CONFIG_SETTING, JSON_NUMBER, (void *)1, "^[10]{1}$");
 	options_add(&threechan->options, 0, "gui-show-battery", OPTION_HAS_VALUE, CONFIG_SETTING, JSON_NUMBER, (void *)1, "^[10]{1}$");
 
-	threechan->parseCode=&threechanParseCode;
+	threechan->decodeCode=&threechanParseCode;
 	threechan->checkValues=&threechanCheckValues;
 	threechan->gc=&threechanGC;
 }
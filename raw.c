@@ -41,6 +41,7 @@
 #include "gc.h"
 
 static unsigned short main_loop = 1;
+static unsigned short timestamps = 0;
 static pthread_t pth;
 
 int main_gc(void) {
@@ -71,13 +72,20 @@ int main_gc(void) {
 }
 
 void *receive_code(void *param) {
+	struct hardware_pulse_t pulse;
 	int duration = 0;
 
 	struct hardware_t *hw = (hardware_t *)param;
 	while(main_loop && hw->receive) {
-		duration = hw->receive();
+		duration = hw->receive(&pulse);
 		if(duration > 0) {
-			printf("%s: %d\n", hw->id, duration);
+			/* Timestamps are printed in microseconds as
+			   read by the 433replay hardware module */
+			if(timestamps == 1) {
+				printf("%s: %llu %d\n", hw->id, pulse.timestamp/1000, duration);
+			} else {
+				printf("%s: %d\n", hw->id, duration);
+			}
 		}
 	};
 	return NULL;
@@ -112,6 +120,7 @@ int main(int argc, char **argv) {
 	options_add(&options, 'H', "help", OPTION_NO_VALUE, 0, JSON_NULL, NULL, NULL);
 	options_add(&options, 'V', "version", OPTION_NO_VALUE, 0, JSON_NULL, NULL, NULL);
 	options_add(&options, 'F', "settings", OPTION_HAS_VALUE, 0, JSON_NULL, NULL, NULL);
+	options_add(&options, 'T', "timestamps", OPTION_NO_VALUE, 0, JSON_NULL, NULL, NULL);
 
 	while (1) {
 		int c;
@@ -126,6 +135,7 @@ int main(int argc, char **argv) {
 				printf("\t -H --help\t\tdisplay usage summary\n");
 				printf("\t -V --version\t\tdisplay version\n");
 				printf("\t -F --settings\t\tsettings file\n");
+				printf("\t -T --timestamps\tprint the timestamp of every pulse\n");
 				goto close;
 			break;
 			case 'V':
@@ -137,6 +147,9 @@ int main(int argc, char **argv) {
 					goto close;
 				}
 			break;
+			case 'T':
+				timestamps = 1;
+			break;
 			default:
 				printf("Usage: %s [options]\n", progname);
 				goto close;
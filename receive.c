@@ -73,6 +73,8 @@ int main(int argc, char **argv) {
 	struct ssdp_list_t *ssdp_list = NULL;
 
 	char *server = NULL;
+	char socketfile[] = SOCKET_FILE;
+	char *socket_file = socketfile;
 	unsigned short port = 0;
 
     char *recvBuff = NULL;
@@ -80,10 +82,14 @@ int main(int argc, char **argv) {
 	char *args = NULL;
 	steps_t steps = WELCOME;
 
+	char settingstmp[] = SETTINGS_FILE;
+	settings_set_file(settingstmp);
+
 	options_add(&options, 'H', "help", OPTION_NO_VALUE, 0, JSON_NULL, NULL, NULL);
 	options_add(&options, 'V', "version", OPTION_NO_VALUE, 0, JSON_NULL, NULL, NULL);
 	options_add(&options, 'S', "server", OPTION_HAS_VALUE, 0, JSON_NULL, NULL, "^(([0-9]|[1-9][0-9]|1[0-9]{2}|2[0-4][0-9]|25[0-5]).){3}([0-9]|[1-9][0-9]|1[0-9]{2}|2[0-4][0-9]|25[0-5])$");
 	options_add(&options, 'P', "port", OPTION_HAS_VALUE, 0, JSON_NULL, NULL, "[0-9]{1,4}");
+	options_add(&options, 'F', "settings", OPTION_HAS_VALUE, 0, JSON_NULL, NULL, NULL);
 
 	/* Store all CLI arguments for later usage
 	   and also check if the CLI arguments where
@@ -102,6 +108,7 @@ int main(int argc, char **argv) {
 				printf("\t -V --version\t\t\tdisplay version\n");
 				printf("\t -S --server=x.x.x.x\t\tconnect to server address\n");
 				printf("\t -P --port=xxxx\t\t\tconnect to server port\n");
+				printf("\t -F --settings\t\t\tsettings file\n");
 				exit(EXIT_SUCCESS);
 			break;
 			case 'V':
@@ -118,6 +125,11 @@ int main(int argc, char **argv) {
 			case 'P':
 				port = (unsigned short)atoi(args);
 			break;
+			case 'F':
+				if(settings_set_file(args) == EXIT_FAILURE) {
+					return EXIT_FAILURE;
+				}
+			break;
 			default:
 				printf("Usage: %s -l location -d device\n", progname);
 				exit(EXIT_SUCCESS);
@@ -126,11 +138,18 @@ int main(int argc, char **argv) {
 	}
 	options_delete(options);
 
+	if(settings_read() != 0) {
+		return EXIT_FAILURE;
+	}
+	settings_find_string("socket-file", &socket_file);
+
 	if(server && port > 0) {
 		if((sockfd = socket_connect(server, port)) == -1) {
 			logprintf(LOG_ERR, "could not connect to pilight-daemon");
 			return EXIT_FAILURE;
 		}
+	} else if(strlen(socket_file) > 0 && (sockfd = socket_connect(socket_file, 0)) != -1) {
+		/* A daemon running on this machine, no need to look for it */
 	} else if(ssdp_seek(&ssdp_list) == -1) {
 		logprintf(LOG_ERR, "no pilight ssdp connections found");
 		goto close;
@@ -203,6 +222,7 @@ close:
 		sfree((void *)&recvBuff);
 	}
 	options_gc();
+	settings_gc();
 	log_shell_disable();
 	log_gc();
 	return EXIT_SUCCESS;
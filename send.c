@@ -122,10 +122,15 @@ int main(int argc, char **argv) {
 	int protohelp = 0;
 
 	char *server = NULL;
+	char socketfile[] = SOCKET_FILE;
+	char *socket_file = socketfile;
 	unsigned short port = 0;
 
 	/* Hold the final protocol struct */
 	protocol_t *protocol = NULL;
+	/* Holds the code created by the protocol */
+	struct protocol_decode_t decode;
+	int ret = 0;
 	JsonNode *code = NULL;
 
 	char settingstmp[] = SETTINGS_FILE;
@@ -189,6 +194,7 @@ int main(int argc, char **argv) {
 	if(settings_read() != 0) {
 		return EXIT_FAILURE;
 	}
+	settings_find_string("socket-file", &socket_file);
 
 	/* Initialize protocols */
 	protocol_init();
@@ -339,15 +345,21 @@ int main(int argc, char **argv) {
 		tmp = tmp->next;
 	}
 
-	if(protocol->createCode(code) == 0) {
-		if(protocol->message) {
-			json_delete(protocol->message);
-		}
+	decode.message = NULL;
+	protocol_bind(protocol, &decode);
+	ret = protocol->createCode(code);
+	protocol_unbind(protocol, &decode);
+	if(decode.message) {
+		json_delete(decode.message);
+	}
+	if(ret == 0) {
 		if(server && port > 0) {
 			if((sockfd = socket_connect(server, port)) == -1) {
 				logprintf(LOG_ERR, "could not connect to pilight-daemon");
 				goto close;
 			}
+		} else if(strlen(socket_file) > 0 && (sockfd = socket_connect(socket_file, 0)) != -1) {
+			/* A daemon running on this machine, no need to look for it */
 		} else if(ssdp_seek(&ssdp_list) == -1) {
 			logprintf(LOG_ERR, "no pilight ssdp connections found");
 			goto close;